@@ -7,6 +7,8 @@
 //                          Copyright 2007 OpenLibSys.org. All rights reserved.
 //-----------------------------------------------------------------------------
 
+#ifdef _WIN32
+
 #include <iostream>
 #include <tchar.h>
 #include <windows.h>
@@ -381,3 +383,5 @@ BYTE Driver::driverFileExistence()
 	driverFileExist = TRUE;
 	return OLS_DLL_NO_ERROR;
 }
+
+#endif
@@ -1,12 +1,10 @@
-#include <map>
 #include <fstream>
 #include <sstream>
 #include <iomanip>
 #include <iostream>
-#include <windows.h>
+#include <thread>
 
 #include "ec.hpp"
-#include "driver.hpp"
 
 EmbeddedController::EmbeddedController(
     BYTE scPort,
@@ -14,6 +12,17 @@ EmbeddedController::EmbeddedController(
     BYTE endianness,
     UINT16 retry,
     UINT16 timeout)
+    : EmbeddedController(defaultPortIo(), scPort, dataPort, endianness, retry, timeout)
+{
+}
+
+EmbeddedController::EmbeddedController(
+    std::shared_ptr<PortIo> io,
+    BYTE scPort,
+    BYTE dataPort,
+    BYTE endianness,
+    UINT16 retry,
+    UINT16 timeout)
 {
     this->scPort = scPort;
     this->dataPort = dataPort;
@@ -21,62 +30,144 @@ EmbeddedController::EmbeddedController(
     this->retry = retry;
     this->timeout = timeout;
 
-    this->driver = Driver();
-    if (this->driver.initialize())
+    this->io = io;
+    if (this->io && this->io->initialize())
         this->driverLoaded = TRUE;
 
-    this->driverFileExist = driver.driverFileExist;
+    this->driverFileExist = this->io && this->io->available();
 }
 
 VOID EmbeddedController::close()
 {
-    this->driver.deinitialize();
+    if (this->io)
+        this->io->deinitialize();
     this->driverLoaded = FALSE;
 }
 
 EC_DUMP EmbeddedController::dump()
+{
+    return this->dump(EC_REGISTERS().set());
+}
+
+EC_DUMP EmbeddedController::dump(const EC_REGISTERS& registers)
 {
     EC_DUMP _dump;
-    for (UINT16 column = 0x00; column <= 0xF0; column += 0x10)
-        for (UINT16 row = 0x00; row <= 0x0F; row++)
-        {
-            UINT16 address = column + row;
-            _dump.insert(std::pair<BYTE, BYTE>(address, this->readByte(address)));
-        }
+    _dump.timestamp = std::chrono::steady_clock::now();
+    if (registers.none())
+        return _dump;
+
+    if (this->io && this->io->directAccess())
+    {
+        // A single read spanning all selected registers is cheaper than one syscall per register
+        UINT16 first = 0x00;
+        UINT16 last = 0xFF;
+        while (!registers[first])
+            first++;
+        while (!registers[last])
+            last--;
+
+        this->stats.transactions++;
+        BOOL result = this->io->readRam((BYTE)first, _dump.values.data() + first, last - first + 1);
+        this->stats.reads.latency.record(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - _dump.timestamp).count());
+
+        if (result)
+            for (UINT16 address = first; address <= last; address++)
+                _dump.valid[address] = TRUE;
+        else
+            this->stats.reads.failures++;
+        return _dump;
+    }
+
+    BurstSession burst(*this);
+    for (UINT16 address = 0x00; address <= 0xFF; address++)
+        if (registers[address])
+            _dump.valid[address] = this->operation(READ, (BYTE)address, &_dump.values[address]);
 
     return _dump;
 }
 
 VOID EmbeddedController::printDump()
+{
+    printDump(this->dump());
+}
+
+VOID EmbeddedController::printDump(const EC_DUMP& _dump)
 {
     std::stringstream stream;
     stream << std::hex << std::uppercase << std::setfill('0')
         << " # | 00 01 02 03 04 05 06 07 08 09 0A 0B 0C 0D 0E 0F" << std::endl
-        << "---|------------------------------------------------" << std::endl
-        << "00 | ";
+        << "---|------------------------------------------------";
 
-    for (auto const& [address, value] : this->dump())
+    for (UINT16 address = 0x00; address <= 0xFF; address++)
     {
-        UINT16 nextAddress = address + 0x01;
-        stream << std::setw(2) << (UINT16)value << " ";
-        if (nextAddress % 0x10 == 0x00) // End of row
+        if (address % 0x10 == 0x00) // Start of row
             stream << std::endl
-            << nextAddress << " | ";
+            << std::setw(2) << address << " | ";
+
+        if (_dump.valid[address])
+            stream << std::setw(2) << (UINT16)_dump.values[address] << " ";
+        else
+            stream << "?? ";
     }
 
-    std::string result = stream.str();
     std::cout << std::endl
-        << result.substr(0, result.size() - 7) // Removing last 7 characters
+        << stream.str()
         << std::endl;
 }
 
+VOID EmbeddedController::printStats()
+{
+    std::stringstream stream;
+    stream << "transactions: " << this->stats.transactions << std::endl;
+
+    for (auto const& [name, operation] : { std::make_pair("read", &this->stats.reads), std::make_pair("write", &this->stats.writes) })
+    {
+        const EC_HISTOGRAM& latency = operation->latency;
+        stream << name << ": " << latency.count << " ops, "
+            << operation->retries << " retries, "
+            << operation->failures << " failures";
+        if (latency.count)
+            stream << ", avg " << latency.totalNs / latency.count << "ns"
+                << ", p50 <" << latency.percentile(0.5) << "ns"
+                << ", p99 <" << latency.percentile(0.99) << "ns"
+                << ", max " << latency.maxNs << "ns";
+        stream << std::endl;
+
+        for (UINT16 i = 0; i < latency.buckets.size(); i++)
+            if (latency.buckets[i])
+                stream << "    <" << std::setw(11) << (2ULL << i) << "ns: " << latency.buckets[i] << std::endl;
+    }
+
+    for (auto const& [name, poll] : { std::make_pair("ibf", &this->stats.ibf), std::make_pair("obf", &this->stats.obf) })
+    {
+        stream << name << ": " << poll->waits << " waits, "
+            << poll->polls << " polls, "
+            << poll->timeouts << " timeouts, "
+            << poll->spinHits << "/" << poll->backoffHits << "/" << poll->sleepHits << " spin/backoff/sleep";
+        if (poll->waits)
+            stream << ", avg " << poll->totalNs / poll->waits << "ns"
+                << ", max " << poll->maxNs << "ns";
+        stream << std::endl;
+    }
+
+    if (this->stats.staleBytes)
+        stream << "late replies discarded: " << this->stats.staleBytes << std::endl;
+
+    std::cout << stream.str();
+}
+
 VOID EmbeddedController::saveDump(std::string output)
+{
+    saveDump(this->dump(), output);
+}
+
+VOID EmbeddedController::saveDump(const EC_DUMP& _dump, std::string output)
 {
     std::ofstream file(output, std::ios::out | std::ios::binary);
     if (file)
     {
-        for (auto const& [address, value] : this->dump())
-            file << this->readByte(address);
+        file.write((const char*)_dump.values.data(), _dump.values.size());
         file.close();
     }
 }
@@ -90,6 +181,7 @@ BYTE EmbeddedController::readByte(BYTE bRegister)
 
 WORD EmbeddedController::readWord(BYTE bRegister)
 {
+    BurstSession burst(*this);
     BYTE firstByte = 0x00;
     BYTE secondByte = 0x00;
     WORD result = 0x00;
@@ -107,6 +199,7 @@ WORD EmbeddedController::readWord(BYTE bRegister)
 
 DWORD EmbeddedController::readDword(BYTE bRegister)
 {
+    BurstSession burst(*this);
     BYTE firstByte = 0x00;
     BYTE secondByte = 0x00;
     BYTE thirdByte = 0x00;
@@ -145,6 +238,7 @@ BOOL EmbeddedController::writeWord(BYTE bRegister, WORD value)
     if (endianness == BIG_ENDIAN)
         std::swap(firstByte, secondByte);
 
+    BurstSession burst(*this);
     if (this->operation(WRITE, bRegister, &firstByte) &&
         this->operation(WRITE, bRegister + 0x01, &secondByte))
         return TRUE;
@@ -164,6 +258,7 @@ BOOL EmbeddedController::writeDword(BYTE bRegister, DWORD value)
         std::swap(secondByte, thirdByte);
     }
 
+    BurstSession burst(*this);
     if (this->operation(WRITE, bRegister, &firstByte) &&
         this->operation(WRITE, bRegister + 0x01, &secondByte) &&
         this->operation(WRITE, bRegister + 0x02, &thirdByte) &&
@@ -172,49 +267,227 @@ BOOL EmbeddedController::writeDword(BYTE bRegister, DWORD value)
     return FALSE;
 }
 
+BOOL EmbeddedController::beginBurst()
+{
+    if (this->burstDepth++ > 0)
+        return this->burstActive;
+
+    if (!this->useBurst || !this->io || this->io->directAccess())
+        return FALSE;
+
+    auto deadline = this->budget();
+    BYTE ack = 0x00;
+    if (this->status(EC_IBF, deadline)) // Wait until IBF is free
+    {
+        if (this->outputStale)
+            this->drainOutput();
+        this->io->writeIoPortByte(this->scPort, BE_EC); // Request burst mode on the Status/Command port
+        this->outputStale = TRUE;                       // Until the acknowledge is read, it may still come late
+        if (this->status(EC_OBF, deadline))             // Wait until OBF is full
+        {
+            ack = this->io->readIoPortByte(this->dataPort); // Read burst acknowledge byte from the Data port
+            this->outputStale = FALSE;
+        }
+    }
+
+    this->burstActive = ack == BURST_ACK;
+    this->inputDrained = this->burstActive;
+    // A busy EC may miss a single request, only one that keeps refusing lacks burst support
+    // and isn't worth paying the timeouts again
+    if (this->burstActive)
+        this->burstRefused = 0;
+    else if (++this->burstRefused >= this->burstRefusals)
+        this->useBurst = FALSE;
+
+    return this->burstActive;
+}
+
+VOID EmbeddedController::endBurst()
+{
+    if (this->burstDepth == 0 || --this->burstDepth > 0 || !this->burstActive)
+        return;
+
+    auto deadline = this->budget();
+    if (this->status(EC_IBF, deadline))                 // Wait until IBF is free
+        this->io->writeIoPortByte(this->scPort, BD_EC); // Leave burst mode on the Status/Command port
+    this->status(EC_IBF, deadline);                     // Wait until IBF is free
+
+    this->burstActive = FALSE;
+    this->inputDrained = FALSE;
+}
+
 BOOL EmbeddedController::operation(BYTE mode, BYTE bRegister, BYTE* value)
+{
+    BOOL isRead = mode == READ;
+    EC_OPERATION_STATS& stats = isRead ? this->stats.reads : this->stats.writes;
+
+    if (!this->io)
+        return FALSE;
+
+    this->stats.transactions++;
+    auto begin = std::chrono::steady_clock::now();
+
+    BOOL result = FALSE;
+    if (this->io->directAccess())
+        result = isRead ? this->io->readRam(bRegister, value, 1) : this->io->writeRam(bRegister, value, 1);
+    else
+    {
+        // Retries share the budget, a dead EC costs `operationUs` per byte and not retry times every wait
+        auto deadline = this->budget();
+        for (UINT16 i = 0; i < this->retry && !result && (i == 0 || std::chrono::steady_clock::now() < deadline); i++)
+        {
+            if (i > 0)
+                stats.retries++;
+            result = this->handshake(mode, bRegister, value, deadline);
+        }
+    }
+
+    stats.latency.record(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - begin).count());
+    if (!result)
+        stats.failures++;
+
+    return result;
+}
+
+BOOL EmbeddedController::handshake(BYTE mode, BYTE bRegister, BYTE* value, std::chrono::steady_clock::time_point deadline)
 {
     BOOL isRead = mode == READ;
     BYTE operationType = isRead ? RD_EC : WR_EC;
 
-    for (UINT16 i = 0; i < this->retry; i++)
-        if (this->status(EC_IBF)) // Wait until IBF is free
+    // In burst mode the EC serves only this host, so once a read has
+    // completed the input buffer is known to be empty and the first wait can be skipped
+    BOOL drained = this->burstActive && this->inputDrained;
+    this->inputDrained = FALSE;
+
+    if (drained || this->status(EC_IBF, deadline)) // Wait until IBF is free
+    {
+        if (this->outputStale)
+            this->drainOutput();
+        this->io->writeIoPortByte(this->scPort, operationType); // Write operation type to the Status/Command port
+        this->outputStale = isRead;                             // Until its reply is read, it may still come late
+        if (this->status(EC_IBF, deadline))                     // Wait until IBF is free
         {
-            this->driver.writeIoPortByte(this->scPort, operationType); // Write operation type to the Status/Command port
-            if (this->status(EC_IBF))                                  // Wait until IBF is free
-            {
-                this->driver.writeIoPortByte(this->dataPort, bRegister); // Write register address to the Data port
-                if (this->status(EC_IBF))                                // Wait until IBF is free
-                    if (isRead)
-                    {
-                        if (this->status(EC_OBF)) // Wait until OBF is full
-                        {
-                            *value = this->driver.readIoPortByte(this->dataPort); // Read from the Data port
-                            return TRUE;
-                        }
-                    }
-                    else
+            this->io->writeIoPortByte(this->dataPort, bRegister); // Write register address to the Data port
+            if (this->status(EC_IBF, deadline))                   // Wait until IBF is free
+                if (isRead)
+                {
+                    if (this->status(EC_OBF, deadline)) // Wait until OBF is full
                     {
-                        this->driver.writeIoPortByte(this->dataPort, *value); // Write to the Data port
+                        *value = this->io->readIoPortByte(this->dataPort); // Read from the Data port
+                        this->inputDrained = TRUE;
+                        this->outputStale = FALSE;
                         return TRUE;
                     }
-            }
+                }
+                else
+                {
+                    this->io->writeIoPortByte(this->dataPort, *value); // Write to the Data port
+                    return TRUE;
+                }
         }
+    }
 
     return FALSE;
 }
 
-BOOL EmbeddedController::status(BYTE flag)
+VOID EmbeddedController::drainOutput()
+{
+    // Bounded, a stuck OBF flag must not hold the handshake forever
+    for (UINT16 i = 0; i < this->timeout && (this->io->readIoPortByte(this->scPort) & EC_OBF); i++)
+    {
+        this->io->readIoPortByte(this->dataPort); // Discard the late byte from the Data port
+        this->stats.staleBytes++;
+    }
+    this->outputStale = FALSE;
+}
+
+std::chrono::steady_clock::time_point EmbeddedController::budget()
+{
+    return std::chrono::steady_clock::now() + std::chrono::microseconds(this->polling.operationUs);
+}
+
+BOOL EmbeddedController::status(BYTE flag, std::chrono::steady_clock::time_point deadline)
 {
     BOOL done = flag == EC_OBF ? 0x01 : 0x00;
-    for (UINT16 i = 0; i < this->timeout; i++)
+    EC_POLL_STATS& stats = done ? this->stats.obf : this->stats.ibf;
+    UINT64* hits = &stats.spinHits;
+
+    auto poll = [&]() -> BOOL
     {
-        BYTE result = this->driver.readIoPortByte(this->scPort);
+        stats.polls++;
+        BYTE result = this->io->readIoPortByte(this->scPort);
         // First and second bit of returned value represent
         // the status of OBF and IBF flags respectively
-        if (((done ? ~result : result) & flag) == 0)
-            return TRUE;
+        return ((done ? ~result : result) & flag) == 0;
+    };
+
+    auto begin = std::chrono::steady_clock::now();
+    BOOL ready = FALSE;
+    for (UINT16 i = 0; i < this->timeout && !ready; i++)
+        ready = poll();
+
+    if (!ready)
+    {
+        auto expiry = begin + std::chrono::microseconds(this->polling.deadlineUs);
+        if (expiry < deadline)
+            deadline = expiry;
+        UINT64 pauseNs = this->polling.backoffMinNs;
+        while (!ready && std::chrono::steady_clock::now() < deadline)
+        {
+            if (pauseNs <= this->polling.backoffMaxNs)
+            {
+                hits = &stats.backoffHits;
+                auto resume = std::chrono::steady_clock::now() + std::chrono::nanoseconds(pauseNs);
+                while (std::chrono::steady_clock::now() < resume)
+                    std::this_thread::yield();
+                pauseNs *= 2;
+            }
+            else
+            {
+                hits = &stats.sleepHits;
+                auto resume = std::chrono::steady_clock::now() + std::chrono::microseconds(this->polling.sleepUs);
+                std::this_thread::sleep_until(resume < deadline ? resume : deadline);
+            }
+            ready = poll();
+        }
     }
 
-    return FALSE;
-}
\ No newline at end of file
+    UINT64 elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - begin).count();
+    stats.waits++;
+    stats.totalNs += elapsed;
+    if (elapsed > stats.maxNs)
+        stats.maxNs = elapsed;
+    if (ready)
+        (*hits)++;
+    else
+        stats.timeouts++;
+
+    return ready;
+}
+
+VOID EC_HISTOGRAM::record(UINT64 ns)
+{
+    UINT16 bucket = 0;
+    while (bucket < this->buckets.size() - 1 && (ns >> (bucket + 1)) != 0)
+        bucket++;
+
+    this->buckets[bucket]++;
+    this->count++;
+    this->totalNs += ns;
+    if (ns > this->maxNs)
+        this->maxNs = ns;
+}
+
+UINT64 EC_HISTOGRAM::percentile(double fraction) const
+{
+    UINT64 rank = (UINT64)(fraction * this->count);
+    UINT64 seen = 0;
+    for (UINT16 bucket = 0; bucket < this->buckets.size(); bucket++)
+    {
+        seen += this->buckets[bucket];
+        if (seen > rank)
+            return 2ULL << bucket;
+    }
+
+    return this->maxNs;
+}
@@ -1,9 +1,12 @@
 #ifndef EC_H
 #define EC_H
 
-#include "map"
+#include "array"
+#include "bitset"
+#include "chrono"
+#include "string"
 
-#include "driver.hpp"
+#include "io.hpp"
 
 auto constexpr VERSION = "0.1";
 
@@ -15,12 +18,91 @@ constexpr BYTE WRITE = 1;
 
 constexpr BYTE EC_OBF = 0x01;  // Output Buffer Full
 constexpr BYTE EC_IBF = 0x02;  // Input Buffer Full
+constexpr BYTE EC_BURST = 0x10; // Burst Mode
 constexpr BYTE EC_DATA = 0x62; // Data Port
 constexpr BYTE EC_SC = 0x66;   // Status/Command Port
 constexpr BYTE RD_EC = 0x80;   // Read Embedded Controller
 constexpr BYTE WR_EC = 0x81;   // Write Embedded Controller
+constexpr BYTE BE_EC = 0x82;   // Burst Enable Embedded Controller
+constexpr BYTE BD_EC = 0x83;   // Burst Disable Embedded Controller
+constexpr BYTE BURST_ACK = 0x90; // Burst Acknowledge Byte
 
-typedef std::map<BYTE, BYTE> EC_DUMP;
+/** Polling strategy for EC's OBF and IBF flags once the initial tight spin has not succeeded */
+struct EC_POLLING
+{
+    UINT32 backoffMinNs = 1000;   // First pause between polls, doubled after every poll
+    UINT32 backoffMaxNs = 250000; // Longest pause, polling switches to sleeping beyond it
+    UINT32 sleepUs = 1000;        // Sleep between polls once backoff is exhausted
+    UINT32 deadlineUs = 1000;     // Give up a single wait after this long
+    UINT32 operationUs = 2000;    // Give up a read or write, all of its waits and retries, after this long
+};
+
+/** Statistics of waits on a single EC status flag */
+struct EC_POLL_STATS
+{
+    UINT64 waits = 0;       // Number of waits
+    UINT64 polls = 0;       // Status port reads over all waits
+    UINT64 spinHits = 0;    // Waits finished during the tight spin
+    UINT64 backoffHits = 0; // Waits finished during the backoff
+    UINT64 sleepHits = 0;   // Waits finished while sleeping
+    UINT64 timeouts = 0;    // Waits that reached the deadline
+    UINT64 totalNs = 0;     // Time spent waiting
+    UINT64 maxNs = 0;       // Longest wait
+};
+
+/** Log2 histogram of latencies, bucket `i` counts samples below 2^(i+1) nanoseconds */
+struct EC_HISTOGRAM
+{
+    std::array<UINT64, 40> buckets = {};
+    UINT64 count = 0;
+    UINT64 totalNs = 0;
+    UINT64 maxNs = 0;
+
+    /**
+     * Add a sample to the histogram.
+     * @param ns Latency in nanoseconds.
+     */
+    VOID record(UINT64 ns);
+
+    /**
+     * Estimate a latency percentile.
+     * @param fraction Percentile as a fraction, e.g. `0.99`.
+     * @return Upper bound of the bucket holding the percentile in nanoseconds.
+     */
+    UINT64 percentile(double fraction) const;
+};
+
+/** Statistics of read or write operations */
+struct EC_OPERATION_STATS
+{
+    EC_HISTOGRAM latency;
+    UINT64 retries = 0;  // Attempts beyond the first one
+    UINT64 failures = 0; // Operations that ran out of retries
+};
+
+/** Instrumentation of all EC traffic */
+struct EC_STATS
+{
+    UINT64 transactions = 0; // Register handshakes or direct RAM accesses
+    EC_OPERATION_STATS reads;
+    EC_OPERATION_STATS writes;
+    EC_POLL_STATS ibf;
+    EC_POLL_STATS obf;
+    UINT64 staleBytes = 0;   // Late replies to timed out requests, discarded before the next handshake
+};
+
+/** Set of EC register addresses */
+typedef std::bitset<0x100> EC_REGISTERS;
+
+/** Snapshot of all EC registers, indexed by register address */
+struct EC_DUMP
+{
+    std::array<BYTE, 0x100> values = {};
+    std::bitset<0x100> valid;                        // Registers that were read successfully
+    std::chrono::steady_clock::time_point timestamp; // Moment the snapshot was started
+
+    BYTE operator[](BYTE bRegister) const { return values[bRegister]; }
+};
 
 /**
  * Implementation of ACPI embedded controller specification to access the EC's RAM
@@ -34,15 +116,35 @@ public:
     BYTE endianness;
     BOOL driverLoaded = FALSE;
     BOOL driverFileExist = FALSE;
+    BOOL useBurst = TRUE;     // Run multi-byte operations in burst mode, cleared if the EC keeps refusing it
+    UINT16 burstRefusals = 3; // Consecutive refusals after which burst mode is no longer requested
+    EC_POLLING polling;
+    EC_STATS stats;
+
+    /**
+     * @param scPort Embedded Controller Status/Command port.
+     * @param dataPort Embedded Controller Data port.
+     * @param endianness Byte order of read and write operations, could be `LITTLE_ENDIAN` or `BIG_ENDIAN`.
+     * @param retry Number of retires for failed read or write operations.
+     * @param timeout Number of back to back polls of EC's OBF and IBF flags before backing off.
+    */
+    EmbeddedController(
+        BYTE scPort = EC_SC,
+        BYTE dataPort = EC_DATA,
+        BYTE endianness = LITTLE_ENDIAN,
+        UINT16 retry = 5,
+        UINT16 timeout = 100);
 
     /**
+     * @param io Port I/O backend used to reach the EC.
      * @param scPort Embedded Controller Status/Command port.
      * @param dataPort Embedded Controller Data port.
      * @param endianness Byte order of read and write operations, could be `LITTLE_ENDIAN` or `BIG_ENDIAN`.
      * @param retry Number of retires for failed read or write operations.
-     * @param timeout Waiting threshold for reading EC's OBF and IBF flags.
+     * @param timeout Number of back to back polls of EC's OBF and IBF flags before backing off.
     */
     EmbeddedController(
+        std::shared_ptr<PortIo> io,
         BYTE scPort = EC_SC,
         BYTE dataPort = EC_DATA,
         BYTE endianness = LITTLE_ENDIAN,
@@ -53,20 +155,43 @@ public:
     VOID close();
 
     /**
-     * Generate a dump of all registers.
-     * @return Map of register's address and value.
+     * Generate a dump of all registers in a single pass.
+     * @return Snapshot of register values.
      */
     EC_DUMP dump();
 
+    /**
+     * Generate a dump of selected registers in a single ascending pass.
+     * @param registers Set of register addresses to read.
+     * @return Snapshot where only the read registers are valid.
+     */
+    EC_DUMP dump(const EC_REGISTERS& registers);
+
+    /** Print collected statistics of EC traffic */
+    VOID printStats();
+
     /** Print generated dump of all registers */
     VOID printDump();
 
+    /**
+     * Print a dump read before, e.g. in chunks by another thread.
+     * @param dump Snapshot of registers, invalid ones are shown as `??`.
+     */
+    static VOID printDump(const EC_DUMP& dump);
+
     /**
      * Store generated dump of all registers to the disk.
      * @param output Path of output file.
      */
     VOID saveDump(std::string output = "dump.bin");
 
+    /**
+     * Store a dump read before to the disk.
+     * @param dump Snapshot of registers.
+     * @param output Path of output file.
+     */
+    static VOID saveDump(const EC_DUMP& dump, std::string output = "dump.bin");
+
     /**
      * Read EC register as BYTE.
      * @param bRegister Address of register.
@@ -113,13 +238,28 @@ public:
      */
     BOOL writeDword(BYTE bRegister, DWORD value);
 
+    /**
+     * Enter burst mode, the EC stays dedicated to the host until `endBurst`.
+     * Calls can be nested, only the outermost pair talks to the EC.
+     * @return Whether burst mode is active.
+     */
+    BOOL beginBurst();
+
+    /** Leave burst mode entered by `beginBurst` */
+    VOID endBurst();
+
 protected:
     UINT16 retry;
     UINT16 timeout;
-    Driver driver;
+    std::shared_ptr<PortIo> io;
+    UINT16 burstDepth = 0;
+    UINT16 burstRefused = 0; // Refusals since burst mode was last granted
+    BOOL burstActive = FALSE;
+    BOOL inputDrained = FALSE;
+    BOOL outputStale = FALSE; // A request gave up waiting for its reply, which may still arrive
 
     /**
-     * Perform a read or write operation.
+     * Perform a read or write operation, retrying failed handshakes.
      * @param mode Type of operation.
      * @param bRegister Address of register.
      * @param value Value of register.
@@ -127,12 +267,47 @@ protected:
      */
     BOOL operation(BYTE mode, BYTE bRegister, BYTE *value);
 
+    /**
+     * Perform a single read or write handshake.
+     * @param mode Type of operation.
+     * @param bRegister Address of register.
+     * @param value Value of register.
+     * @param deadline End of the time budget of the operation.
+     * @return Successfulness of operation.
+     */
+    BOOL handshake(BYTE mode, BYTE bRegister, BYTE *value, std::chrono::steady_clock::time_point deadline);
+
     /**
      * Check EC status for permission to read or write.
+     * Spins `timeout` polls, then polls with exponentially growing pauses, then sleeps between polls until the deadline.
      * @param flag Type of flag.
+     * @param deadline End of the time budget of the operation, the wait ends at `polling.deadlineUs` if that is earlier.
      * @return Whether allowed to perform read or write.
      */
-    BOOL status(BYTE flag);
+    BOOL status(BYTE flag, std::chrono::steady_clock::time_point deadline);
+
+    /**
+     * Discard bytes left in the output buffer by requests that timed out, e.g. a late burst acknowledge,
+     * so they are not taken for the reply of the next read. Called once the EC has taken its input.
+     */
+    VOID drainOutput();
+
+    /** @return End of the time budget of an operation starting now. */
+    std::chrono::steady_clock::time_point budget();
+};
+
+/** Keeps the EC in burst mode for the lifetime of the object */
+class BurstSession
+{
+public:
+    BurstSession(EmbeddedController& ec) : ec(ec) { ec.beginBurst(); }
+    ~BurstSession() { ec.endBurst(); }
+
+    BurstSession(const BurstSession&) = delete;
+    BurstSession& operator=(const BurstSession&) = delete;
+
+private:
+    EmbeddedController& ec;
 };
 
 #endif
@@ -0,0 +1,101 @@
+#include "io.hpp"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+
+BOOL WinRing0Io::initialize()
+{
+    return this->driver.initialize();
+}
+
+VOID WinRing0Io::deinitialize()
+{
+    this->driver.deinitialize();
+}
+
+BOOL WinRing0Io::available()
+{
+    return this->driver.driverFileExist;
+}
+
+BYTE WinRing0Io::readIoPortByte(BYTE port)
+{
+    return this->driver.readIoPortByte(port);
+}
+
+VOID WinRing0Io::writeIoPortByte(BYTE port, BYTE value)
+{
+    this->driver.writeIoPortByte(port, value);
+}
+
+#else
+
+EcSysIo::EcSysIo(std::string path)
+{
+    this->path = path;
+}
+
+BOOL EcSysIo::initialize()
+{
+    if (this->fd >= 0)
+        return TRUE;
+
+    this->fd = open(this->path.c_str(), O_RDWR);
+    if (this->fd < 0) // Module loaded without write support
+        this->fd = open(this->path.c_str(), O_RDONLY);
+
+    return this->fd >= 0;
+}
+
+VOID EcSysIo::deinitialize()
+{
+    if (this->fd >= 0)
+    {
+        ::close(this->fd);
+        this->fd = -1;
+    }
+}
+
+BOOL EcSysIo::available()
+{
+    return access(this->path.c_str(), F_OK) == 0;
+}
+
+BYTE EcSysIo::readIoPortByte(BYTE)
+{
+    return 0xFF;
+}
+
+VOID EcSysIo::writeIoPortByte(BYTE, BYTE)
+{
+}
+
+BOOL EcSysIo::directAccess()
+{
+    return TRUE;
+}
+
+BOOL EcSysIo::readRam(BYTE bRegister, BYTE* buffer, UINT16 size)
+{
+    return pread(this->fd, buffer, size, bRegister) == size;
+}
+
+BOOL EcSysIo::writeRam(BYTE bRegister, const BYTE* buffer, UINT16 size)
+{
+    return pwrite(this->fd, buffer, size, bRegister) == size;
+}
+
+#endif
+
+std::shared_ptr<PortIo> defaultPortIo(std::string path)
+{
+#ifdef _WIN32
+    return std::make_shared<WinRing0Io>();
+#else
+    return std::make_shared<EcSysIo>(path.empty() ? EC_SYS_PATH : path);
+#endif
+}
@@ -0,0 +1,130 @@
+#ifndef IO_H
+#define IO_H
+
+#include <memory>
+#include <string>
+
+#include "platform.hpp"
+
+#ifdef _WIN32
+#include "driver.hpp"
+#endif
+
+/**
+ * Port I/O backend used by `EmbeddedController` to talk to the EC's Status/Command and Data ports.
+ * Implementations only move single bytes, the ACPI handshake itself lives in `EmbeddedController`.
+*/
+class PortIo
+{
+public:
+    virtual ~PortIo() = default;
+
+    /**
+     * Acquire the backend resources.
+     * @return Successfulness of operation.
+     */
+    virtual BOOL initialize() = 0;
+
+    /** Release the backend resources */
+    virtual VOID deinitialize() = 0;
+
+    /**
+     * Check whether the files required by the backend are present.
+     * @return Whether the backend could be initialized at all.
+     */
+    virtual BOOL available() { return TRUE; }
+
+    /**
+     * Read a byte from I/O port.
+     * @param port Address of port.
+     * @return Value of port.
+     */
+    virtual BYTE readIoPortByte(BYTE port) = 0;
+
+    /**
+     * Write a byte to I/O port.
+     * @param port Address of port.
+     * @param value Value of port.
+     */
+    virtual VOID writeIoPortByte(BYTE port, BYTE value) = 0;
+
+    /**
+     * Check whether the backend exposes the EC RAM directly, bypassing the port handshake.
+     * @return Whether `readRam` and `writeRam` are supported.
+     */
+    virtual BOOL directAccess() { return FALSE; }
+
+    /**
+     * Read a range of EC registers directly.
+     * @param bRegister Address of first register.
+     * @param buffer Destination of register values.
+     * @param size Number of registers.
+     * @return Successfulness of operation.
+     */
+    virtual BOOL readRam([[maybe_unused]] BYTE bRegister, [[maybe_unused]] BYTE* buffer, [[maybe_unused]] UINT16 size) { return FALSE; }
+
+    /**
+     * Write a range of EC registers directly.
+     * @param bRegister Address of first register.
+     * @param buffer Source of register values.
+     * @param size Number of registers.
+     * @return Successfulness of operation.
+     */
+    virtual BOOL writeRam([[maybe_unused]] BYTE bRegister, [[maybe_unused]] const BYTE* buffer, [[maybe_unused]] UINT16 size) { return FALSE; }
+};
+
+#ifdef _WIN32
+
+/** Port I/O through the WinRing0 kernel driver */
+class WinRing0Io : public PortIo
+{
+public:
+    BOOL initialize() override;
+    VOID deinitialize() override;
+    BOOL available() override;
+    BYTE readIoPortByte(BYTE port) override;
+    VOID writeIoPortByte(BYTE port, BYTE value) override;
+
+protected:
+    Driver driver;
+};
+
+#else
+
+auto constexpr EC_SYS_PATH = "/sys/kernel/debug/ec/ec0/io";
+
+/**
+ * EC RAM access through the Linux `ec_sys` debugfs file.
+ * Every register access is a single `pread`/`pwrite`, no port handshake is performed.
+ * Writing requires the module to be loaded with `write_support=1`.
+*/
+class EcSysIo : public PortIo
+{
+public:
+    /** @param path Path of the EC RAM file, any regular file of 256 bytes works as well. */
+    EcSysIo(std::string path = EC_SYS_PATH);
+
+    BOOL initialize() override;
+    VOID deinitialize() override;
+    BOOL available() override;
+    BYTE readIoPortByte(BYTE port) override;
+    VOID writeIoPortByte(BYTE port, BYTE value) override;
+    BOOL directAccess() override;
+    BOOL readRam(BYTE bRegister, BYTE* buffer, UINT16 size) override;
+    BOOL writeRam(BYTE bRegister, const BYTE* buffer, UINT16 size) override;
+
+protected:
+    std::string path;
+    int fd = -1;
+};
+
+#endif
+
+/**
+ * Create the port I/O backend of the current platform.
+ * @param path EC RAM file of `EcSysIo`, `EC_SYS_PATH` when empty. Not used on Windows.
+ * @return `WinRing0Io` on Windows, `EcSysIo` elsewhere.
+ */
+std::shared_ptr<PortIo> defaultPortIo(std::string path = "");
+
+#endif
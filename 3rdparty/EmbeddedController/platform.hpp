@@ -0,0 +1,32 @@
+#ifndef PLATFORM_H
+#define PLATFORM_H
+
+#ifdef _WIN32
+
+#include <windows.h>
+
+#else
+
+#include <cstdint>
+#include <cstdlib>
+#include <endian.h>
+
+// <endian.h> macros collide with the byte order constants from `ec.hpp`
+#undef LITTLE_ENDIAN
+#undef BIG_ENDIAN
+
+typedef uint8_t BYTE;
+typedef uint16_t WORD;
+typedef uint32_t DWORD;
+typedef uint16_t UINT16;
+typedef uint32_t UINT32;
+typedef uint64_t UINT64;
+typedef int BOOL;
+
+#define VOID void
+#define TRUE 1
+#define FALSE 0
+
+#endif
+
+#endif
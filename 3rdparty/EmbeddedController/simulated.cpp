@@ -0,0 +1,169 @@
+#include "simulated.hpp"
+
+SimulatedEc::SimulatedEc(SimulatedLatency latency, BYTE scPort, BYTE dataPort)
+{
+    this->latency = latency;
+    this->scPort = scPort;
+    this->dataPort = dataPort;
+}
+
+BOOL SimulatedEc::initialize()
+{
+    return TRUE;
+}
+
+VOID SimulatedEc::deinitialize()
+{
+}
+
+BYTE SimulatedEc::readIoPortByte(BYTE port)
+{
+    this->portReads++;
+    if (port == this->scPort)
+    {
+        this->spin(this->latency.scNs);
+        this->tick();
+        return (this->obf ? EC_OBF : 0x00) |
+            (this->ibf ? EC_IBF : 0x00) |
+            (this->inputIsCommand ? 0x08 : 0x00) | // CMD flag: last input byte was a command
+            (this->burst ? EC_BURST : 0x00);
+    }
+    if (port == this->dataPort)
+    {
+        this->spin(this->latency.dataNs);
+        BYTE value = this->outputBuffer;
+        this->obf = FALSE;
+        if (this->outputQueued)
+        {
+            this->outputQueued = FALSE;
+            this->output(this->queuedOutput);
+        }
+        return value;
+    }
+
+    return 0xFF;
+}
+
+VOID SimulatedEc::writeIoPortByte(BYTE port, BYTE value)
+{
+    this->portWrites++;
+    if (port != this->scPort && port != this->dataPort)
+        return;
+
+    // Writing while IBF is set overwrites the unconsumed byte, as on real hardware
+    this->spin(port == this->scPort ? this->latency.scNs : this->latency.dataNs);
+    this->inputBuffer = value;
+    this->inputIsCommand = port == this->scPort;
+    this->ibf = TRUE;
+    this->ibfCountdown = this->burst ? 0 : this->latency.ibfPolls;
+    if (this->latency.ibfNs && !this->burst)
+        this->ibfDeadline = std::chrono::steady_clock::now() + std::chrono::nanoseconds(this->latency.ibfNs);
+}
+
+BYTE SimulatedEc::peek(BYTE bRegister)
+{
+    return this->ram[bRegister];
+}
+
+VOID SimulatedEc::poke(BYTE bRegister, BYTE value)
+{
+    this->ram[bRegister] = value;
+}
+
+VOID SimulatedEc::tick()
+{
+    if (this->ibf && this->elapsed(this->ibfCountdown, this->ibfDeadline, this->burst ? 0 : this->latency.ibfNs))
+        this->consume();
+
+    if (this->outputPending && this->elapsed(this->obfCountdown, this->obfDeadline, this->burst ? 0 : this->latency.obfNs))
+    {
+        this->outputPending = FALSE;
+        this->obf = TRUE;
+    }
+}
+
+VOID SimulatedEc::consume()
+{
+    this->ibf = FALSE;
+
+    if (this->inputIsCommand)
+    {
+        switch (this->inputBuffer)
+        {
+        case RD_EC:
+            this->phase = Phase::READ_ADDRESS;
+            break;
+        case WR_EC:
+            this->phase = Phase::WRITE_ADDRESS;
+            break;
+        case BE_EC:
+            this->burst = TRUE;
+            this->phase = Phase::IDLE;
+            this->output(BURST_ACK);
+            break;
+        case BD_EC:
+            this->burst = FALSE;
+            this->phase = Phase::IDLE;
+            break;
+        default: // Unsupported command, drop any transaction in progress
+            this->phase = Phase::IDLE;
+            break;
+        }
+        return;
+    }
+
+    switch (this->phase)
+    {
+    case Phase::READ_ADDRESS:
+        this->output(this->ram[this->inputBuffer]);
+        this->phase = Phase::IDLE;
+        break;
+    case Phase::WRITE_ADDRESS:
+        this->address = this->inputBuffer;
+        this->phase = Phase::WRITE_DATA;
+        break;
+    case Phase::WRITE_DATA:
+        this->ram[this->address] = this->inputBuffer;
+        this->phase = Phase::IDLE;
+        break;
+    default: // Data without a command is ignored
+        break;
+    }
+}
+
+VOID SimulatedEc::output(BYTE value)
+{
+    if (this->obf || this->outputPending)
+    {
+        this->queuedOutput = value;
+        this->outputQueued = TRUE;
+        return;
+    }
+
+    this->outputBuffer = value;
+    this->outputPending = TRUE;
+    this->obfCountdown = this->burst ? 0 : this->latency.obfPolls;
+    if (this->latency.obfNs && !this->burst)
+        this->obfDeadline = std::chrono::steady_clock::now() + std::chrono::nanoseconds(this->latency.obfNs);
+}
+
+BOOL SimulatedEc::elapsed(UINT16& countdown, std::chrono::steady_clock::time_point deadline, UINT32 ns)
+{
+    if (countdown > 0)
+    {
+        countdown--;
+        return FALSE;
+    }
+
+    return ns == 0 || std::chrono::steady_clock::now() >= deadline;
+}
+
+VOID SimulatedEc::spin(UINT32 ns)
+{
+    if (ns == 0)
+        return;
+
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::nanoseconds(ns);
+    while (std::chrono::steady_clock::now() < deadline)
+        ;
+}
@@ -0,0 +1,116 @@
+#ifndef SIMULATED_H
+#define SIMULATED_H
+
+#include <chrono>
+
+#include "ec.hpp"
+
+/** Simulated cost of port accesses and EC processing */
+struct SimulatedLatency
+{
+    UINT32 scNs = 0;     // Cost of a single Status/Command port access in nanoseconds
+    UINT32 dataNs = 0;   // Cost of a single Data port access in nanoseconds
+    UINT16 ibfPolls = 0; // Status reads before the EC consumes the input buffer
+    UINT16 obfPolls = 0; // Status reads before the EC fills the output buffer
+    UINT32 ibfNs = 0;    // Time before the EC consumes the input buffer in nanoseconds
+    UINT32 obfNs = 0;    // Time before the EC fills the output buffer in nanoseconds
+};
+
+/**
+ * In-memory ACPI embedded controller behind the port I/O interface.
+ * Models the 256-byte EC RAM and the IBF/OBF handshake of `RD_EC`/`WR_EC` commands.
+ * In burst mode (`BE_EC`/`BD_EC`) the EC is dedicated to the host and skips the IBF/OBF poll latency,
+ * so `EmbeddedController` can be exercised and benchmarked without the hardware.
+*/
+class SimulatedEc : public PortIo
+{
+public:
+    SimulatedLatency latency;
+    UINT64 portReads = 0;
+    UINT64 portWrites = 0;
+
+    /**
+     * @param latency Simulated cost of port accesses and EC processing.
+     * @param scPort Embedded Controller Status/Command port.
+     * @param dataPort Embedded Controller Data port.
+    */
+    SimulatedEc(SimulatedLatency latency = SimulatedLatency(), BYTE scPort = EC_SC, BYTE dataPort = EC_DATA);
+
+    BOOL initialize() override;
+    VOID deinitialize() override;
+    BYTE readIoPortByte(BYTE port) override;
+    VOID writeIoPortByte(BYTE port, BYTE value) override;
+
+    /**
+     * Read EC RAM directly, bypassing the ports.
+     * @param bRegister Address of register.
+     * @return Value of register.
+     */
+    BYTE peek(BYTE bRegister);
+
+    /**
+     * Write EC RAM directly, bypassing the ports.
+     * @param bRegister Address of register.
+     * @param value Value of register.
+     */
+    VOID poke(BYTE bRegister, BYTE value);
+
+protected:
+    enum class Phase
+    {
+        IDLE,
+        READ_ADDRESS,
+        WRITE_ADDRESS,
+        WRITE_DATA
+    };
+
+    BYTE scPort;
+    BYTE dataPort;
+    BYTE ram[0x100] = {};
+
+    Phase phase = Phase::IDLE;
+    BYTE address = 0x00;
+    BYTE inputBuffer = 0x00;
+    BYTE outputBuffer = 0x00;
+    BOOL inputIsCommand = FALSE;
+    BOOL ibf = FALSE;
+    BOOL obf = FALSE;
+    BOOL outputPending = FALSE;
+    BOOL outputQueued = FALSE;    // A reply waits behind an unread one, as a late reply does on real hardware
+    BYTE queuedOutput = 0x00;
+    BOOL burst = FALSE;
+    UINT16 ibfCountdown = 0;
+    UINT16 obfCountdown = 0;
+    std::chrono::steady_clock::time_point ibfDeadline;
+    std::chrono::steady_clock::time_point obfDeadline;
+
+    /** Advance the EC by one status poll */
+    VOID tick();
+
+    /** Process the byte latched in the input buffer */
+    VOID consume();
+
+    /**
+     * Place a byte in the output buffer, OBF is raised after the configured latency.
+     * While the host hasn't read the previous byte, the new one is queued behind it.
+     * @param value Value of output buffer.
+     */
+    VOID output(BYTE value);
+
+    /**
+     * Busy-wait to emulate the cost of a port access.
+     * @param ns Duration in nanoseconds.
+     */
+    VOID spin(UINT32 ns);
+
+    /**
+     * Check whether the EC finished processing.
+     * @param countdown Remaining status polls, decremented when nonzero.
+     * @param deadline Moment the processing time elapses.
+     * @param ns Configured processing time, the clock is not read when zero.
+     * @return Whether both the poll and time latency have passed.
+     */
+    BOOL elapsed(UINT16& countdown, std::chrono::steady_clock::time_point deadline, UINT32 ns);
+};
+
+#endif
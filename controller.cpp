@@ -0,0 +1,65 @@
+#include "controller.hpp"
+
+#include <cmath>
+
+FanController::FanController(FanControlSettings settings)
+    : settings(settings)
+{
+}
+
+BOOL FanController::update(double temperature, UINT64 nowMs, int& duty)
+{
+    const FanControlSettings& s = this->settings;
+    double dt = this->started ? (nowMs - this->lastMs) / 1000.0 : 0;
+    double error = temperature - s.target;
+
+    if (dt > 0) // Sensor steps are whole degrees, the slope is smoothed so the D term doesn't spike on each step
+        this->slope += 0.3 * ((temperature - this->lastTemperature) / dt - this->slope);
+    this->started = TRUE;
+    this->lastMs = nowMs;
+    this->lastTemperature = temperature;
+
+    // Anti-windup by conditional integration: while the output is pinned at a bound, an error
+    // pushing it further past the bound is not integrated, so the integral is ready to act as
+    // soon as the temperature turns instead of having to unwind first
+    double integral = this->integral + error * dt;
+    double unclamped = s.minDuty + s.kp * error + s.ki * integral + s.kd * this->slope;
+    BOOL saturated = (unclamped > s.maxDuty && error > 0) || (unclamped < s.minDuty && error < 0);
+    if (!saturated)
+        this->integral = integral;
+
+    double output = s.minDuty + s.kp * error + s.ki * this->integral + s.kd * this->slope;
+    output = output > s.maxDuty ? s.maxDuty : output < s.minDuty ? s.minDuty : output;
+    BOOL critical = temperature >= s.critical;
+    if (critical)
+        output = s.maxDuty;
+    this->lastOutput = output;
+
+    int next = (int)std::lround(output);
+    if (this->written && next == this->lastDuty)
+        return FALSE;
+
+    // Reaching a bound is always written, so the band can't leave the fan just short of it
+    BOOL bound = next == (int)std::lround(s.minDuty) || next == (int)std::lround(s.maxDuty);
+    if (this->written && !critical && !bound && std::abs(next - this->lastDuty) < s.hysteresis)
+    {
+        this->hysteresisSkips++;
+        return FALSE;
+    }
+    if (this->written && !critical && nowMs - this->lastWriteMs < s.minWriteIntervalMs)
+    {
+        this->rateLimitSkips++;
+        return FALSE;
+    }
+
+    duty = next;
+    return TRUE;
+}
+
+VOID FanController::commit(int duty, UINT64 nowMs)
+{
+    this->written = TRUE;
+    this->lastWriteMs = nowMs;
+    this->lastDuty = duty;
+    this->writes++;
+}
@@ -0,0 +1,68 @@
+#ifndef CONTROLLER_H
+#define CONTROLLER_H
+
+#include "3rdparty/EmbeddedController/platform.hpp"
+
+/** Tuning of a FanController, temperatures in C and duties in percent of fan speed */
+struct FanControlSettings
+{
+    double target = 70;
+    double critical = 90;              // From here on full speed, without waiting for the rate limit
+    double kp = 3;                     // Percent per C of error
+    double ki = 0.1;                   // Percent per C*s of accumulated error
+    double kd = 2;                     // Percent per C/s of temperature slope
+    double minDuty = 0;
+    double maxDuty = 100;
+    double hysteresis = 5;             // Smaller duty changes are not written
+    UINT64 minWriteIntervalMs = 2000;  // Least time between two writes
+};
+
+/**
+ * PID loop from a temperature to a fan duty.
+ * The duty is only reported for writing when it moved past the hysteresis band
+ * and the previous write is older than the write interval, so the EC sees a
+ * handful of writes per minute however fast the loop runs. A reported duty only
+ * counts as written once `commit` confirms it, until then every update reports it again.
+*/
+class FanController
+{
+public:
+    FanController(FanControlSettings settings = FanControlSettings());
+
+    /**
+     * Feed a temperature sample.
+     * @param temperature Current temperature.
+     * @param nowMs Monotonic time of the sample in milliseconds.
+     * @param duty Destination of the duty to write.
+     * @return Whether duty should be written now.
+     */
+    BOOL update(double temperature, UINT64 nowMs, int& duty);
+
+    /**
+     * Record a successful write of the duty reported by `update`.
+     * @param duty Duty written.
+     * @param nowMs Monotonic time of the write in milliseconds.
+     */
+    VOID commit(int duty, UINT64 nowMs);
+
+    /** @return Unrounded controller output of the last update. */
+    double output() { return this->lastOutput; }
+
+    UINT64 writes = 0;
+    UINT64 hysteresisSkips = 0;  // Updates whose duty change was inside the band
+    UINT64 rateLimitSkips = 0;   // Updates that had to wait for the write interval
+
+protected:
+    FanControlSettings settings;
+    BOOL started = FALSE;
+    BOOL written = FALSE;
+    UINT64 lastMs = 0;
+    UINT64 lastWriteMs = 0;
+    double lastTemperature = 0;
+    double slope = 0;
+    double integral = 0;
+    double lastOutput = 0;
+    int lastDuty = 0;
+};
+
+#endif
@@ -0,0 +1,62 @@
+// Generated by fan_speed_editor -gen from ems1583.json, do not edit
+#pragma once
+
+namespace regmap
+{
+constexpr const char* MODEL = "ems1583";
+constexpr const char* ADDRESS_FILE = "ems1583.json";
+
+// name, { address, width, byte order, signed, { scale factor, offset, reciprocal } }, saveable, changeable
+constexpr RegisterDescriptor PARAMS[] = {
+    { "cpu_fan_speed_t1", { 0x72, 1, LITTLE_ENDIAN, false, { 1, 0, false } }, true, true },
+    { "cpu_fan_speed_t2", { 0x73, 1, LITTLE_ENDIAN, false, { 1, 0, false } }, true, true },
+    { "cpu_fan_speed_t3", { 0x74, 1, LITTLE_ENDIAN, false, { 1, 0, false } }, true, true },
+    { "cpu_fan_speed_t4", { 0x75, 1, LITTLE_ENDIAN, false, { 1, 0, false } }, true, true },
+    { "cpu_fan_speed_t5", { 0x76, 1, LITTLE_ENDIAN, false, { 1, 0, false } }, true, true },
+    { "cpu_fan_speed_t6", { 0x77, 1, LITTLE_ENDIAN, false, { 1, 0, false } }, true, true },
+    { "cpu_fan_speed_t7", { 0x78, 1, LITTLE_ENDIAN, false, { 1, 0, false } }, true, true },
+    { "cpu_temp_t1", { 0x6A, 1, LITTLE_ENDIAN, false, { 1, 0, false } }, false, true },
+    { "cpu_temp_t2", { 0x6B, 1, LITTLE_ENDIAN, false, { 1, 0, false } }, false, true },
+    { "cpu_temp_t3", { 0x6C, 1, LITTLE_ENDIAN, false, { 1, 0, false } }, false, true },
+    { "cpu_temp_t4", { 0x6D, 1, LITTLE_ENDIAN, false, { 1, 0, false } }, false, true },
+    { "cpu_temp_t5", { 0x6E, 1, LITTLE_ENDIAN, false, { 1, 0, false } }, false, true },
+    { "cpu_temp_t6", { 0x6F, 1, LITTLE_ENDIAN, false, { 1, 0, false } }, false, true },
+    { "fan_mode", { 0xD4, 1, LITTLE_ENDIAN, false, { 1, 0, false } }, true, true },
+    { "gpu_fan_speed_t1", { 0x8A, 1, LITTLE_ENDIAN, false, { 1, 0, false } }, true, true },
+    { "gpu_fan_speed_t2", { 0x8B, 1, LITTLE_ENDIAN, false, { 1, 0, false } }, true, true },
+    { "gpu_fan_speed_t3", { 0x8C, 1, LITTLE_ENDIAN, false, { 1, 0, false } }, true, true },
+    { "gpu_fan_speed_t4", { 0x8D, 1, LITTLE_ENDIAN, false, { 1, 0, false } }, true, true },
+    { "gpu_fan_speed_t5", { 0x8E, 1, LITTLE_ENDIAN, false, { 1, 0, false } }, true, true },
+    { "gpu_fan_speed_t6", { 0x8F, 1, LITTLE_ENDIAN, false, { 1, 0, false } }, true, true },
+    { "gpu_fan_speed_t7", { 0x90, 1, LITTLE_ENDIAN, false, { 1, 0, false } }, true, true },
+    { "gpu_temp_t1", { 0x82, 1, LITTLE_ENDIAN, false, { 1, 0, false } }, false, true },
+    { "gpu_temp_t2", { 0x83, 1, LITTLE_ENDIAN, false, { 1, 0, false } }, false, true },
+    { "gpu_temp_t3", { 0x84, 1, LITTLE_ENDIAN, false, { 1, 0, false } }, false, true },
+    { "gpu_temp_t4", { 0x85, 1, LITTLE_ENDIAN, false, { 1, 0, false } }, false, true },
+    { "gpu_temp_t5", { 0x86, 1, LITTLE_ENDIAN, false, { 1, 0, false } }, false, true },
+    { "gpu_temp_t6", { 0x87, 1, LITTLE_ENDIAN, false, { 1, 0, false } }, false, true },
+    { "realtime_cpu_fan_rpm", { 0xC8, 2, BIG_ENDIAN, false, { 478000, 0, true } }, false, false },
+    { "realtime_cpu_fan_speed", { 0x71, 1, LITTLE_ENDIAN, false, { 1, 0, false } }, false, false },
+    { "realtime_cpu_temp", { 0x68, 1, LITTLE_ENDIAN, false, { 1, 0, false } }, false, false },
+    { "realtime_gpu_fan_rpm", { 0xCA, 2, BIG_ENDIAN, false, { 478000, 0, true } }, false, false },
+    { "realtime_gpu_fan_speed", { 0x89, 1, LITTLE_ENDIAN, false, { 1, 0, false } }, false, false },
+    { "realtime_gpu_temp", { 0x80, 1, LITTLE_ENDIAN, false, { 1, 0, false } }, false, false },
+    { "shift_mode", { 0xD2, 1, LITTLE_ENDIAN, false, { 1, 0, false } }, true, true },
+    { "usb_power_share", { 0xBF, 1, LITTLE_ENDIAN, false, { 1, 0, false } }, true, true },
+};
+
+// param index, code, label
+constexpr CategoryLabel CATEGORIES[] = {
+    { 13, 0x0D, "Auto" },
+    { 13, 0x1D, "Silent" },
+    { 13, 0x4D, "Basic" },
+    { 13, 0x8D, "Advanced" },
+    { 33, 0x80, "Off" },
+    { 33, 0xC0, "Sport" },
+    { 33, 0xC1, "Comfort" },
+    { 33, 0xC2, "Eco" },
+    { 33, 0xC4, "Turbo" },
+    { 34, 0x08, "Off" },
+    { 34, 0x28, "On" },
+};
+}
@@ -0,0 +1,110 @@
+#include "ec_lock.hpp"
+
+#include <thread>
+
+#ifndef _WIN32
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <unistd.h>
+#endif
+
+EcLock::EcLock(std::string name)
+{
+    this->name = name;
+}
+
+EcLock::~EcLock()
+{
+    this->close();
+}
+
+VOID EcLock::record(std::chrono::steady_clock::time_point begin, BOOL contended, BOOL acquired)
+{
+    this->stats.wait.record(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - begin).count());
+    if (contended)
+        this->stats.contended++;
+    if (acquired)
+        this->stats.acquisitions++;
+    else
+        this->stats.timeouts++;
+}
+
+#ifdef _WIN32
+
+BOOL EcLock::open()
+{
+    this->close();
+    this->mutex = CreateMutexA(NULL, FALSE, this->name.c_str());
+    return this->mutex != NULL;
+}
+
+BOOL EcLock::acquire(UINT32 timeoutMs)
+{
+    auto begin = std::chrono::steady_clock::now();
+    DWORD result = WaitForSingleObject(this->mutex, 0);
+    BOOL contended = result == WAIT_TIMEOUT;
+    if (contended)
+        result = WaitForSingleObject(this->mutex, timeoutMs);
+
+    // An abandoned mutex was held by a process that died, it is ours now
+    BOOL acquired = result == WAIT_OBJECT_0 || result == WAIT_ABANDONED;
+    this->record(begin, contended, acquired);
+    return acquired;
+}
+
+VOID EcLock::release()
+{
+    ReleaseMutex(this->mutex);
+}
+
+VOID EcLock::close()
+{
+    if (this->mutex)
+        CloseHandle(this->mutex);
+    this->mutex = NULL;
+}
+
+#else
+
+BOOL EcLock::open()
+{
+    this->close();
+    this->fd = ::open(this->name.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0666);
+    return this->fd >= 0;
+}
+
+BOOL EcLock::acquire(UINT32 timeoutMs)
+{
+    auto begin = std::chrono::steady_clock::now();
+    BOOL acquired = flock(this->fd, LOCK_EX | LOCK_NB) == 0;
+    BOOL contended = !acquired && errno == EWOULDBLOCK;
+
+    // flock() can't time out, poll with growing pauses instead of blocking for good
+    auto deadline = begin + std::chrono::milliseconds(timeoutMs);
+    auto pause = std::chrono::microseconds(50);
+    while (contended && !acquired && std::chrono::steady_clock::now() < deadline)
+    {
+        std::this_thread::sleep_for(pause);
+        if (pause < std::chrono::milliseconds(1))
+            pause *= 2;
+        acquired = flock(this->fd, LOCK_EX | LOCK_NB) == 0;
+    }
+
+    this->record(begin, contended, acquired);
+    return acquired;
+}
+
+VOID EcLock::release()
+{
+    flock(this->fd, LOCK_UN);
+}
+
+VOID EcLock::close()
+{
+    if (this->fd >= 0)
+        ::close(this->fd);
+    this->fd = -1;
+}
+
+#endif
@@ -0,0 +1,77 @@
+#ifndef EC_LOCK_H
+#define EC_LOCK_H
+
+#include <string>
+
+#include "3rdparty/EmbeddedController/ec.hpp"
+
+#ifdef _WIN32
+auto constexpr EC_LOCK_NAME = "Global\\Access_EC"; // Mutex other EC and sensor tools take for ports 0x62/0x66 too
+#else
+auto constexpr EC_LOCK_NAME = "/run/fan_speed_editor.lock";
+#endif
+
+/** Statistics of waits for the EC lock */
+struct EcLockStats
+{
+    UINT64 acquisitions = 0;
+    UINT64 contended = 0; // Acquisitions that found the lock held
+    UINT64 timeouts = 0;  // Waits that gave up, only safety writes then run without the lock
+    EC_HISTOGRAM wait;
+};
+
+/**
+ * System-wide lock over the EC ports, so two processes never interleave handshakes.
+ * Uses a named mutex on Windows and flock() on a lock file elsewhere, the OS releases
+ * it when the holder dies. Meant to be held for a batch of transactions, not a byte.
+*/
+class EcLock
+{
+public:
+    /** @param name Mutex name or lock file path. */
+    EcLock(std::string name = EC_LOCK_NAME);
+    ~EcLock();
+
+    EcLock(const EcLock&) = delete;
+    EcLock& operator=(const EcLock&) = delete;
+
+    /**
+     * Open or create the mutex or lock file.
+     * @return Successfulness of operation.
+     */
+    BOOL open();
+
+    /**
+     * Wait for the lock.
+     * @param timeoutMs Longest wait, a stuck holder must not stall fan control forever.
+     * @return Whether the lock is held, FALSE after a timeout.
+     */
+    BOOL acquire(UINT32 timeoutMs = 1000);
+
+    /** Release the lock taken by a successful `acquire` */
+    VOID release();
+
+    /** Close the mutex or lock file */
+    VOID close();
+
+    EcLockStats stats;
+
+protected:
+    std::string name;
+
+#ifdef _WIN32
+    HANDLE mutex = NULL;
+#else
+    int fd = -1;
+#endif
+
+    /**
+     * Add a wait to the statistics.
+     * @param begin Start of the wait.
+     * @param contended Whether the lock was held by someone else.
+     * @param acquired Whether the wait ended with the lock.
+     */
+    VOID record(std::chrono::steady_clock::time_point begin, BOOL contended, BOOL acquired);
+};
+
+#endif
@@ -0,0 +1,369 @@
+#include <iostream>
+
+#include "ec_worker.hpp"
+
+EcQueue::EcQueue() : head(&this->stub), tail(&this->stub)
+{
+}
+
+VOID EcQueue::push(EcRequest* request)
+{
+    request->next.store(nullptr, std::memory_order_relaxed);
+    EcRequest* previous = this->head.exchange(request);
+    // Until this store the request is queued but unreachable, pop() reports an empty queue meanwhile
+    previous->next.store(request, std::memory_order_release);
+}
+
+EcRequest* EcQueue::pop()
+{
+    EcRequest* tail = this->tail;
+    EcRequest* next = tail->next.load(std::memory_order_acquire);
+    if (tail == &this->stub)
+    {
+        if (!next)
+            return nullptr;
+        this->tail = tail = next;
+        next = next->next.load(std::memory_order_acquire);
+    }
+
+    if (next)
+    {
+        this->tail = next;
+        return tail;
+    }
+
+    if (tail != this->head.load())
+        return nullptr;
+
+    // tail is the last request, queue the stub behind it so it can be unlinked
+    this->push(&this->stub);
+    next = tail->next.load(std::memory_order_acquire);
+    if (next)
+    {
+        this->tail = next;
+        return tail;
+    }
+    return nullptr;
+}
+
+BOOL EcQueue::empty()
+{
+    return this->tail == &this->stub && this->head.load() == &this->stub;
+}
+
+EcWorker::EcWorker(EmbeddedController& ec, EcLock* lock) : ec(ec), systemLock(lock)
+{
+    this->batch.reserve(MAX_BATCH);
+    this->thread = std::thread(&EcWorker::run, this);
+}
+
+EcWorker::~EcWorker()
+{
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->stopping = true;
+    }
+    this->wakeup.notify_one();
+    if (this->thread.joinable())
+        this->thread.join();
+}
+
+std::future<EC_DUMP> EcWorker::read(const EC_REGISTERS& registers, BYTE priority, EC_DEADLINE deadline)
+{
+    EcRequest* request = new EcRequest();
+    request->mode = READ;
+    request->priority = priority;
+    request->deadline = deadline;
+    request->registers = registers;
+    std::future<EC_DUMP> future = request->dump.get_future();
+    this->submit(request);
+    return future;
+}
+
+std::future<BOOL> EcWorker::write(const EC_REGISTERS& registers, const std::array<BYTE, 0x100>& values, BYTE priority, EC_DEADLINE deadline)
+{
+    EcRequest* request = new EcRequest();
+    request->mode = WRITE;
+    request->priority = priority;
+    request->deadline = deadline;
+    request->registers = registers;
+    request->values = values;
+    std::future<BOOL> future = request->result.get_future();
+    this->submit(request);
+    return future;
+}
+
+std::future<BOOL> EcWorker::execute(std::function<VOID(EmbeddedController&)> task, BYTE priority, BOOL needsLock)
+{
+    EcRequest* request = new EcRequest();
+    request->mode = EC_TASK;
+    request->priority = priority;
+    request->task = std::move(task);
+    request->needsLock = needsLock;
+    std::future<BOOL> future = request->result.get_future();
+    this->submit(request);
+    return future;
+}
+
+VOID EcWorker::submit(EcRequest* request)
+{
+    request->queued = std::chrono::steady_clock::now();
+    this->queues[request->priority < EC_CLASSES ? request->priority : EC_BULK].push(request);
+    // Pairs with run(): either it sees the request before parking, or it is parked and we notify
+    if (this->sleeping.load())
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->wakeup.notify_one();
+    }
+}
+
+BOOL EcWorker::empty()
+{
+    for (EcQueue& queue : this->queues)
+        if (!queue.empty())
+            return FALSE;
+    return TRUE;
+}
+
+VOID EcWorker::run()
+{
+    while (TRUE)
+    {
+        if (this->serve())
+            continue;
+
+        if (!this->empty()) // A producer is between its swap and its link
+        {
+            std::this_thread::yield();
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(this->mutex);
+        if (this->stopping)
+            return;
+        this->sleeping = true;
+        while (this->empty() && !this->stopping)
+            this->wakeup.wait(lock);
+        this->sleeping = false;
+    }
+}
+
+BOOL EcWorker::serve()
+{
+    for (BYTE priority : { EC_SAFETY, EC_REALTIME })
+    {
+        this->batch.clear();
+        for (EcRequest* request; this->batch.size() < MAX_BATCH && (request = this->queues[priority].pop()); )
+            if (request->needsLock)
+                this->batch.push_back(request);
+            else // Leaves the ports alone, so it is neither held up by the lock nor refused
+            {
+                this->counters.requests++;
+                this->start(request, std::chrono::steady_clock::now());
+                this->complete(request);
+            }
+
+        if (!this->batch.empty())
+        {
+            if (this->bulk)
+                this->counters.preemptions++;
+            BOOL locked = this->systemLock && this->systemLock->acquire();
+            if (this->systemLock && !locked)
+            {
+                // Reads and fan duty can wait for the next tick, a missed safety write cannot
+                if (priority != EC_SAFETY)
+                {
+                    this->refuse(this->batch);
+                    return TRUE;
+                }
+                this->counters.unlocked++;
+                std::cerr << "Warning: EC lock timed out, running " << this->batch.size() << " safety requests without it" << std::endl;
+            }
+            this->process(this->batch);
+            if (locked)
+                this->systemLock->release();
+            return TRUE;
+        }
+    }
+
+    if (!this->bulk)
+    {
+        EcRequest* request = this->queues[EC_BULK].pop();
+        if (!request)
+            return FALSE;
+        this->counters.requests++;
+        if (!this->start(request, std::chrono::steady_clock::now()))
+            return TRUE;
+        if (!request->needsLock)
+        {
+            this->complete(request);
+            return TRUE;
+        }
+
+        this->bulk = request;
+        this->bulkLeft = request->registers;
+        this->bulkResult = EC_DUMP();
+        this->bulkResult.timestamp = std::chrono::steady_clock::now();
+    }
+
+    BOOL locked = this->systemLock && this->systemLock->acquire();
+    if (this->systemLock && !locked)
+    {
+        // The chunks read so far were read holding the lock, the rest is left unread
+        EcRequest* request = this->bulk;
+        this->bulk = nullptr;
+        this->counters.classes[EC_BULK].refused++;
+        if (request->mode == READ)
+        {
+            request->dump.set_value(this->bulkResult);
+            delete request;
+        }
+        else
+            this->fail(request, std::chrono::steady_clock::now());
+        return TRUE;
+    }
+    this->step();
+    if (locked)
+        this->systemLock->release();
+    return TRUE;
+}
+
+BOOL EcWorker::start(EcRequest* request, std::chrono::steady_clock::time_point now)
+{
+    EcClassStats& stats = this->counters.classes[request->priority < EC_CLASSES ? request->priority : EC_BULK];
+    stats.wait.record(std::chrono::duration_cast<std::chrono::nanoseconds>(now - request->queued).count());
+    if (now <= request->deadline)
+        return TRUE;
+
+    // Too late to be useful, the EC is left alone
+    stats.expired++;
+    this->fail(request, now);
+    return FALSE;
+}
+
+VOID EcWorker::fail(EcRequest* request, std::chrono::steady_clock::time_point now)
+{
+    if (request->mode == READ)
+    {
+        EC_DUMP empty;
+        empty.timestamp = now;
+        request->dump.set_value(empty);
+    }
+    else
+        request->result.set_value(FALSE);
+    delete request;
+}
+
+VOID EcWorker::refuse(std::vector<EcRequest*>& requests)
+{
+    auto now = std::chrono::steady_clock::now();
+    this->counters.requests += requests.size();
+    for (EcRequest* request : requests)
+    {
+        this->counters.classes[request->priority < EC_CLASSES ? request->priority : EC_BULK].refused++;
+        this->fail(request, now);
+    }
+    requests.clear();
+}
+
+VOID EcWorker::process(std::vector<EcRequest*>& requests)
+{
+    this->counters.batches++;
+    this->counters.requests += requests.size();
+    if (requests.size() > this->counters.maxBatch)
+        this->counters.maxBatch = requests.size();
+
+    // Expired requests leave the batch before anything runs
+    auto now = std::chrono::steady_clock::now();
+    size_t kept = 0;
+    for (EcRequest* request : requests)
+        if (this->start(request, now))
+            requests[kept++] = request;
+    requests.resize(kept);
+
+    size_t i = 0;
+    while (i < requests.size())
+    {
+        if (requests[i]->mode != READ)
+        {
+            this->complete(requests[i++]);
+            continue;
+        }
+
+        // One ascending pass over all registers of the adjacent reads
+        size_t end = i;
+        EC_REGISTERS registers;
+        for (; end < requests.size() && requests[end]->mode == READ; end++)
+            registers |= requests[end]->registers;
+
+        EC_DUMP snapshot = this->ec.dump(registers);
+        this->counters.readPasses++;
+        this->counters.coalesced += end - i - 1;
+        for (; i < end; i++)
+        {
+            EC_DUMP result = snapshot;
+            result.valid &= requests[i]->registers;
+            requests[i]->dump.set_value(result);
+            delete requests[i];
+        }
+    }
+}
+
+VOID EcWorker::step()
+{
+    EcRequest* request = this->bulk;
+    if (request->mode != READ)
+    {
+        this->bulk = nullptr;
+        this->complete(request);
+        return;
+    }
+
+    EC_REGISTERS chunk;
+    UINT16 count = 0;
+    for (UINT16 address = 0x00; address <= 0xFF && count < BULK_CHUNK; address++)
+        if (this->bulkLeft[address])
+        {
+            chunk.set(address);
+            this->bulkLeft.reset(address);
+            count++;
+        }
+
+    if (count)
+    {
+        EC_DUMP part = this->ec.dump(chunk);
+        this->counters.chunks++;
+        for (UINT16 address = 0x00; address <= 0xFF; address++)
+            if (chunk[address])
+                this->bulkResult.values[address] = part.values[address];
+        this->bulkResult.valid |= part.valid & chunk;
+    }
+
+    if (this->bulkLeft.none())
+    {
+        request->dump.set_value(this->bulkResult);
+        delete request;
+        this->bulk = nullptr;
+    }
+}
+
+VOID EcWorker::complete(EcRequest* request)
+{
+    if (request->mode == WRITE)
+    {
+        BOOL ok = TRUE;
+        {
+            BurstSession burst(this->ec);
+            for (UINT16 address = 0x00; address <= 0xFF; address++)
+                if (request->registers[address])
+                    ok = this->ec.writeByte((BYTE)address, request->values[address]) && ok;
+        }
+        request->result.set_value(ok);
+    }
+    else
+    {
+        request->task(this->ec);
+        request->result.set_value(TRUE);
+    }
+    delete request;
+}
@@ -0,0 +1,224 @@
+#ifndef EC_WORKER_H
+#define EC_WORKER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "ec_lock.hpp"
+
+constexpr BYTE EC_TASK = 2; // Run a callback with the EC to itself
+
+// Priority classes, a class is only served while all classes before it are empty
+constexpr BYTE EC_SAFETY = 0;   // Writes that protect the hardware, e.g. fan curves and rollbacks
+constexpr BYTE EC_REALTIME = 1; // Sensor reads
+constexpr BYTE EC_BULK = 2;     // Dumps, read in chunks that yield to the other classes
+constexpr BYTE EC_CLASSES = 3;
+
+typedef std::chrono::steady_clock::time_point EC_DEADLINE;
+constexpr EC_DEADLINE EC_NO_DEADLINE = EC_DEADLINE::max();
+
+/** Operation queued for the EC thread, linked into its queue by `next` */
+struct EcRequest
+{
+    std::atomic<EcRequest*> next{ nullptr };
+    BYTE mode = READ;
+    BYTE priority = EC_REALTIME;
+    EC_REGISTERS registers;
+    std::array<BYTE, 0x100> values = {};                // Values of the registers of a write
+    std::function<VOID(EmbeddedController&)> task;
+    BOOL needsLock = TRUE;                              // A task that only reads counters runs without the EC lock
+    std::chrono::steady_clock::time_point queued;
+    EC_DEADLINE deadline = EC_NO_DEADLINE;              // Dropped when not started by then
+    std::promise<EC_DUMP> dump;                         // Result of a read
+    std::promise<BOOL> result;                          // Result of a write or task
+};
+
+/** Intrusive lock-free list of requests, any thread pushes and only the EC thread pops */
+class EcQueue
+{
+public:
+    EcQueue();
+
+    EcQueue(const EcQueue&) = delete;
+    EcQueue& operator=(const EcQueue&) = delete;
+
+    /** Link a request into the queue */
+    VOID push(EcRequest* request);
+
+    /** @return Oldest request, or nullptr when empty or a push is halfway done. */
+    EcRequest* pop();
+
+    /** @return Whether no request is queued or being pushed. */
+    BOOL empty();
+
+protected:
+    std::atomic<EcRequest*> head; // Last queued request, producers swap themselves in
+    EcRequest* tail;              // Oldest queued request
+    EcRequest stub;               // Keeps the list non-empty so pushes never race pops
+};
+
+/** Statistics of a priority class */
+struct EcClassStats
+{
+    EC_HISTOGRAM wait;  // Time from queueing to the start of service
+    UINT64 expired = 0; // Requests dropped at their deadline
+    UINT64 refused = 0; // Requests failed because the EC lock timed out
+};
+
+/** Statistics of the EC thread */
+struct EcWorkerStats
+{
+    UINT64 requests = 0;
+    UINT64 batches = 0;     // Drained runs of safety or realtime requests
+    UINT64 readPasses = 0;  // Dumps run for adjacent reads
+    UINT64 coalesced = 0;   // Reads served by a pass run for an earlier read
+    UINT64 maxBatch = 0;
+    UINT64 chunks = 0;      // Bulk read chunks
+    UINT64 preemptions = 0; // Batches served between the chunks of a bulk read
+    UINT64 unlocked = 0;    // Safety batches run without the EC lock after it timed out
+    std::array<EcClassStats, EC_CLASSES> classes;
+};
+
+/**
+ * Single owner thread of an EmbeddedController.
+ * The port handshake is not thread-safe, so every thread queues its reads and writes here
+ * instead and waits on the returned future. Each priority class has an intrusive lock-free
+ * MPSC queue, producers never block each other or the EC thread, the mutex only parks an idle thread.
+ * Adjacent reads of a class are merged into a single dump of the union of their registers,
+ * bulk reads run `BULK_CHUNK` registers at a time and the other classes are served in between.
+ * Order is kept within a class, a caller that needs order across classes waits for the first future.
+ * With an EcLock, each batch and each bulk chunk runs holding it, so other processes get in between.
+ * When the lock times out, realtime batches and the bulk request in progress fail as if expired
+ * (a bulk read keeps the chunks already read), only safety batches run without it, with a warning.
+*/
+class EcWorker
+{
+public:
+    static constexpr UINT16 BULK_CHUNK = 16;
+
+    /**
+     * @param ec Controller to own, it must not be used elsewhere while the worker runs.
+     * @param lock Opened system-wide lock to hold during transactions, or nullptr.
+     */
+    EcWorker(EmbeddedController& ec, EcLock* lock = nullptr);
+
+    /** Finish the queued requests and stop the thread */
+    ~EcWorker();
+
+    EcWorker(const EcWorker&) = delete;
+    EcWorker& operator=(const EcWorker&) = delete;
+
+    /**
+     * Queue a read of registers.
+     * @param registers Set of register addresses to read.
+     * @param priority Priority class.
+     * @param deadline Latest start, a later read is dropped and returns no valid registers.
+     * @return Snapshot where only the requested registers are valid, none when it was dropped or the EC lock timed out.
+     */
+    std::future<EC_DUMP> read(const EC_REGISTERS& registers, BYTE priority = EC_REALTIME, EC_DEADLINE deadline = EC_NO_DEADLINE);
+
+    /**
+     * Queue a write of registers, run in a single burst session.
+     * @param registers Set of register addresses to write.
+     * @param values Value of each register, indexed by register address.
+     * @param priority Priority class.
+     * @param deadline Latest start, a later write is dropped and fails.
+     * @return Successfulness of operation, FALSE when the EC lock timed out outside the safety class.
+     */
+    std::future<BOOL> write(
+        const EC_REGISTERS& registers,
+        const std::array<BYTE, 0x100>& values,
+        BYTE priority = EC_SAFETY,
+        EC_DEADLINE deadline = EC_NO_DEADLINE);
+
+    /**
+     * Queue a callback, for anything that needs the controller itself, e.g. its statistics.
+     * @param task Called on the EC thread between other requests.
+     * @param priority Priority class, a bulk task is not split.
+     * @param needsLock Whether the callback talks to the EC. One that doesn't, e.g. reads statistics,
+     * runs as soon as it is dequeued, ahead of the rest of its batch, without taking the EC lock.
+     * @return TRUE once the callback returned, FALSE when it was not run because the EC lock timed out.
+     */
+    std::future<BOOL> execute(std::function<VOID(EmbeddedController&)> task, BYTE priority = EC_REALTIME, BOOL needsLock = TRUE);
+
+    /** Statistics, only stable from a task or once the worker is idle */
+    const EcWorkerStats& stats() { return this->counters; }
+
+protected:
+    static constexpr size_t MAX_BATCH = 256;
+
+    EmbeddedController& ec;
+    EcLock* systemLock;
+    std::array<EcQueue, EC_CLASSES> queues;
+    std::vector<EcRequest*> batch;
+    EcWorkerStats counters;
+
+    // Bulk read in progress
+    EcRequest* bulk = nullptr;
+    EC_REGISTERS bulkLeft;
+    EC_DUMP bulkResult;
+
+    std::atomic<bool> sleeping{ false };
+    std::atomic<bool> stopping{ false };
+    std::mutex mutex;
+    std::condition_variable wakeup;
+    std::thread thread;
+
+    /** Queue a request and wake the EC thread if it is parked */
+    VOID submit(EcRequest* request);
+
+    /** @return Whether no request of any class is queued or being pushed. */
+    BOOL empty();
+
+    /** Thread body, serves the classes in order and parks when all are empty */
+    VOID run();
+
+    /**
+     * Serve the most urgent work: a safety or realtime batch, else one bulk step.
+     * @return Whether there was work.
+     */
+    BOOL serve();
+
+    /**
+     * Record the queueing latency of a request and drop it if it missed its deadline.
+     * @param request Request about to start.
+     * @param now Current time.
+     * @return Whether the request should run.
+     */
+    BOOL start(EcRequest* request, std::chrono::steady_clock::time_point now);
+
+    /**
+     * Complete a request without running it: a read with no valid registers, a write or task with FALSE.
+     * @param request Request, deleted once complete.
+     * @param now Current time, stamped on a read.
+     */
+    VOID fail(EcRequest* request, std::chrono::steady_clock::time_point now);
+
+    /**
+     * Fail a batch that could not get the EC lock.
+     * @param requests Requests, deleted and removed from the batch.
+     */
+    VOID refuse(std::vector<EcRequest*>& requests);
+
+    /**
+     * Run a batch in queue order, merging runs of reads.
+     * @param requests Requests, deleted once complete.
+     */
+    VOID process(std::vector<EcRequest*>& requests);
+
+    /** Run the next chunk of the bulk read, or the whole bulk write or task */
+    VOID step();
+
+    /**
+     * Run a write or task and complete it.
+     * @param request Request, deleted once complete.
+     */
+    VOID complete(EcRequest* request);
+};
+
+#endif
@@ -1,313 +1,2279 @@
 ﻿#include <iostream>
 #include <map>
 #include <set>
-#include <windows.h>
 #include <memory>
 #include <fstream>
 #include <string>
+#include <chrono>
+#include <cstring>
+#include <sstream>
+#include <vector>
+#include <array>
+#include <filesystem>
+#include <thread>
+#include <algorithm>
+#include <ctime>
+#include <csignal>
 
+#ifndef FIXED_REGISTER_MAP
 #include "3rdparty/nlohmann/json.hpp"
+#endif
 #include "3rdparty/EmbeddedController/ec.hpp"
+#include "3rdparty/EmbeddedController/simulated.hpp"
+#include "ipc.hpp"
+#include "ec_worker.hpp"
+#include "read_cache.hpp"
+#include "mapped_file.hpp"
+#include "telemetry.hpp"
+#include "controller.hpp"
+#include "sampler.hpp"
+#include "shared_snapshot.hpp"
 
+#ifndef FIXED_REGISTER_MAP
 using json = nlohmann::json;
+#endif
 
 #undef NDEBUG
 
 #include <cassert>
 
+struct StartupTimings
+{
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    std::chrono::steady_clock::duration configParse{};
+    std::chrono::steady_clock::duration driverOpen{};
+    std::chrono::steady_clock::duration firstRead{};
+    bool firstReadDone = false;
+    bool configCached = false;
+
+    void print()
+    {
+        auto ms = [](std::chrono::steady_clock::duration d) { return std::chrono::duration<double, std::milli>(d).count(); };
+        std::cerr << "startup: config " << ms(configParse) << "ms" << (configCached ? " (cached), " : ", ")
+            << "driver " << ms(driverOpen) << "ms, "
+            << "first read " << ms(firstRead) << "ms, "
+            << "total " << ms(std::chrono::steady_clock::now() - start) << "ms" << std::endl;
+    }
+};
+
+StartupTimings timings;
+
+#ifndef FIXED_REGISTER_MAP
+
+// Bounds-checked cursor over the mapped config cache
+struct CacheReader
+{
+    const BYTE* cursor;
+    const BYTE* end;
+    bool ok = true;
+
+    UINT64 u64()
+    {
+        UINT64 value = 0;
+        if (end - cursor < (ptrdiff_t)sizeof(value))
+        {
+            ok = false;
+            return 0;
+        }
+        memcpy(&value, cursor, sizeof(value));
+        cursor += sizeof(value);
+        return value;
+    }
+
+    double f64()
+    {
+        UINT64 bits = u64();
+        double value;
+        memcpy(&value, &bits, sizeof(value));
+        return value;
+    }
+
+    std::string str()
+    {
+        UINT64 size = u64();
+        if (!ok || (UINT64)(end - cursor) < size)
+        {
+            ok = false;
+            return std::string();
+        }
+        std::string value((const char*)cursor, size);
+        cursor += size;
+        return value;
+    }
+};
+
+#endif
+
+typedef UINT16 ParamId;
+constexpr ParamId NO_PARAM = 0xFFFF;
+
+// Conversion of a raw register value to its unit: `factor * x + offset`, or `factor / x` when reciprocal
+struct Scale
+{
+    double factor = 1;
+    double offset = 0;
+    bool reciprocal = false;
+
+    double apply(double x) const
+    {
+        if (reciprocal)
+            return x ? factor / x : 0;
+        return factor * x + offset;
+    }
+};
+
+// Layout of a param in EC RAM as declared in the address file
+struct RegisterType
+{
+    BYTE address = 0;               // Lowest register of the param
+    BYTE width = 1;                 // Number of registers, 1, 2 or 4
+    BYTE byteOrder = LITTLE_ENDIAN; // LITTLE_ENDIAN or BIG_ENDIAN for multi-register params
+    bool isSigned = false;
+    Scale scale;
+};
+
+// Raw register bits as an int, two's complement for signed registers narrower than 32 bits
+constexpr int SignExtend(UINT32 raw, BYTE width, bool isSigned)
+{
+    if (!isSigned || width == 4)
+        return (int)raw;
+    UINT32 sign = 1u << (width * 8 - 1);
+    return (int)((raw ^ sign) - sign);
+}
+
+// Entries of a register map generated by `-gen`
+struct RegisterDescriptor
+{
+    const char* name;
+    RegisterType type;
+    bool saveable;
+    bool changeable;
+};
+
+struct CategoryLabel
+{
+    ParamId param;
+    int code;
+    const char* label;
+};
+
+constexpr bool NameEquals(const char* a, const char* b)
+{
+    while (*a && *a == *b)
+        a++, b++;
+    return *a == *b;
+}
+
+template <size_t N>
+constexpr ParamId LookupParam(const RegisterDescriptor (&params)[N], const char* name)
+{
+    for (size_t i = 0; i < N; i++)
+        if (NameEquals(params[i].name, name))
+            return (ParamId)i;
+    return NO_PARAM;
+}
+
+#ifdef FIXED_REGISTER_MAP
+
+#include FIXED_REGISTER_MAP
+
+// Id of a param of the compiled-in register map as a constant, NO_PARAM when the map has none by that name
+#define PARAM(name) std::integral_constant<ParamId, LookupParam(regmap::PARAMS, name)>::value
+
+#else
+
+// Id of a param of the loaded config, NO_PARAM when it has none by that name
+#define PARAM(name) config->params.id(name)
+
+constexpr UINT64 CACHE_MAGIC = 0x3230454843414346; // "FCACHE02"
+
+#endif
+
+// Params interned to dense integer ids at config load, one column per attribute
+struct ParamTable
+{
+    std::vector<std::string> name;
+    std::vector<BYTE> address;
+    std::vector<BYTE> width;
+    std::vector<BYTE> byteOrder;
+    std::vector<bool> isSigned;
+    std::vector<Scale> scale;
+    std::vector<bool> saveable;
+    std::vector<bool> changeable;
+    std::vector<bool> realtime;  // Live sensor params, named with the realtime_ prefix in the address file
+    std::vector<int> category;   // Index into categories, -1 for numeric params
+    std::vector<std::map<int, std::string>> categories;
+#ifndef FIXED_REGISTER_MAP
+    std::map<std::string, ParamId> ids;
+#endif
+
+    ParamId add(std::string param, const RegisterType& type, bool isSaveable, bool isChangeable)
+    {
+        ParamId id = (ParamId)name.size();
+        name.push_back(param);
+        address.push_back(type.address);
+        width.push_back(type.width);
+        byteOrder.push_back(type.byteOrder);
+        isSigned.push_back(type.isSigned);
+        scale.push_back(type.scale);
+        saveable.push_back(isSaveable);
+        changeable.push_back(isChangeable);
+        realtime.push_back(param.rfind("realtime_", 0) == 0);
+        category.push_back(-1);
+#ifndef FIXED_REGISTER_MAP
+        ids[param] = id;
+#endif
+        return id;
+    }
+
+    // Only for names typed by the user or read from a profile, known names go through PARAM()
+    ParamId id(const std::string& param) const
+    {
+#ifdef FIXED_REGISTER_MAP
+        return LookupParam(regmap::PARAMS, param.c_str());
+#else
+        auto it = ids.find(param);
+        return it == ids.end() ? NO_PARAM : it->second;
+#endif
+    }
+
+    // Label of a category code, nullptr for numeric params and unknown codes
+    const std::string* label(ParamId id, int code) const
+    {
+        if (category[id] < 0)
+            return nullptr;
+        auto it = categories[category[id]].find(code);
+        return it == categories[category[id]].end() ? nullptr : &it->second;
+    }
+
+    // Code of a category label, -1 for numeric params and unknown labels
+    int code(ParamId id, const std::string& label) const
+    {
+        if (category[id] >= 0)
+            for (auto& [code, name] : categories[category[id]])
+                if (name == label)
+                    return code;
+        return -1;
+    }
+
+    size_t size() const
+    {
+        return name.size();
+    }
+};
+
+
 struct Config
 {
-    std::map<std::string, int> addresses;
-    std::map<std::string, int> addresses_dual;
+    typedef std::shared_ptr<Config> Ptr;
+
+#ifndef FIXED_REGISTER_MAP
+    // As parsed, interned into params once loaded
+    std::map<std::string, RegisterType> addresses;
     std::set<std::string> saveable_params;
     std::set<std::string> changeable_params;
     std::map<std::string, std::map<int, std::string>> categorical_params;
+#endif
+    std::string address_file;
+    ParamTable params;
 
     Config()
     {
+        auto begin = std::chrono::steady_clock::now();
+#ifdef FIXED_REGISTER_MAP
+        load(regmap::PARAMS, regmap::CATEGORIES);
+#else
         std::string dataDir{ "data/" };
+        std::string cachePath = dataDir + "config.cache";
+
+        timings.configCached = loadCache(dataDir, cachePath);
+        if (!timings.configCached)
+            saveCache(dataDir, parse(dataDir), cachePath);
+        index();
+#endif
+
+        timings.configParse = std::chrono::steady_clock::now() - begin;
+    }
+
+#ifdef FIXED_REGISTER_MAP
+
+    // Ids are the indices into the map, so PARAM() constants and the table agree
+    template <size_t N, size_t M>
+    void load(const RegisterDescriptor (&descriptors)[N], const CategoryLabel (&labels)[M])
+    {
+        address_file = regmap::ADDRESS_FILE;
+        for (const auto& d : descriptors)
+            params.add(d.name, d.type, d.saveable, d.changeable);
+
+        for (const auto& l : labels)
+        {
+            if (l.param == NO_PARAM)
+                continue;
+            if (params.category[l.param] < 0)
+            {
+                params.category[l.param] = (int)params.categories.size();
+                params.categories.emplace_back();
+            }
+            params.categories[params.category[l.param]][l.code] = l.label;
+        }
+    }
+
+#else
+
+    // Ids follow the sorted names, the order -gen emits the map in
+    void index()
+    {
+        for (auto& [param, type] : addresses)
+        {
+            ParamId id = params.add(param, type, saveable_params.count(param) > 0, changeable_params.count(param) > 0);
+            if (categorical_params.find(param) != categorical_params.end())
+            {
+                params.category[id] = (int)params.categories.size();
+                params.categories.push_back(categorical_params[param]);
+            }
+        }
+    }
+
+    // Parses `x`, `x * a`, `x / a`, each optionally followed by `+ b` or `- b`, and `a / x`
+    static Scale parseScale(std::string formula)
+    {
+        std::string f;
+        for (char c : formula)
+            if (c != ' ')
+                f += c;
+
+        Scale scale;
+        size_t pos = 0;
+        if (f.size() > 2 && f.compare(f.size() - 2, 2, "/x") == 0)
+        {
+            scale.factor = std::stod(f.substr(0, f.size() - 2), &pos);
+            assert(pos == f.size() - 2 && "ERROR: unsupported scale formula");
+            scale.reciprocal = true;
+            return scale;
+        }
+
+        assert(!f.empty() && f[0] == 'x' && "ERROR: unsupported scale formula");
+        pos = 1;
+        auto number = [&]()
+        {
+            size_t used = 0;
+            double value = std::stod(f.substr(pos), &used);
+            pos += used;
+            return value;
+        };
+        if (pos < f.size() && f[pos] == '*')
+            pos++, scale.factor = number();
+        else if (pos < f.size() && f[pos] == '/')
+            pos++, scale.factor = 1 / number();
+        if (pos < f.size() && (f[pos] == '+' || f[pos] == '-'))
+            scale.offset = number(); // The sign is part of the number
+        assert(pos == f.size() && "ERROR: unsupported scale formula");
+        return scale;
+    }
+
+    // A param is a hex address, a [high, low] pair of adjacent addresses, or an object
+    // { "address", "width": 8/16/32, "byte_order": "little"/"big", "signed", "scale" }
+    static RegisterType parseRegister(const std::string& name, const json& value)
+    {
+        RegisterType type;
+        // The older forms can't declare a scale, fan speeds there are the tachometer period as before
+        if (!value.is_object() && (name == "realtime_cpu_fan_rpm" || name == "realtime_gpu_fan_rpm"))
+            type.scale = parseScale("478000 / x");
+
+        if (value.is_string())
+            type.address = (BYTE)std::stoul(std::string(value), nullptr, 16);
+        else if (value.is_array())
+        {
+            assert(value.size() == 2 && "array type params can only have size equal to two");
+            int high = std::stoul(std::string(value[0]), nullptr, 16);
+            int low = std::stoul(std::string(value[1]), nullptr, 16);
+            assert((low == high + 1 || high == low + 1) && "ERROR: dual-byte params must use adjacent registers");
+            type.width = 2;
+            type.byteOrder = low == high + 1 ? BIG_ENDIAN : LITTLE_ENDIAN;
+            type.address = (BYTE)(low == high + 1 ? high : low);
+        }
+        else
+        {
+            assert(value.is_object() && value.contains("address") && "ERROR: register object has no address");
+            type.address = (BYTE)std::stoul(std::string(value["address"]), nullptr, 16);
+            if (value.contains("width"))
+            {
+                int bits = value["width"];
+                assert((bits == 8 || bits == 16 || bits == 32) && "ERROR: register width must be 8, 16 or 32");
+                type.width = (BYTE)(bits / 8);
+            }
+            if (value.contains("byte_order"))
+            {
+                std::string order = value["byte_order"];
+                assert((order == "little" || order == "big") && "ERROR: byte_order must be little or big");
+                type.byteOrder = order == "big" ? BIG_ENDIAN : LITTLE_ENDIAN;
+            }
+            if (value.contains("signed"))
+                type.isSigned = value["signed"];
+            if (value.contains("scale"))
+                type.scale = parseScale(value["scale"]);
+        }
+        assert(type.address + type.width <= 0x100 && "ERROR: register is out of EC RAM");
+        return type;
+    }
+
+    // Returns the name of the address file
+    std::string parse(std::string dataDir)
+    {
+        std::string configPath = dataDir + "config.json";
+        std::ifstream configFile(configPath);
+        assert(configFile.is_open() && "Config file does not exist");
+        json config = json::parse(configFile);
+
+        assert(config.contains("address_file") && "address_file option does not exist in config");
+        std::string adressPath = dataDir + std::string(config["address_file"]);
+        std::ifstream adressFile(adressPath);
+        assert(adressFile.is_open() && "Adress file does not exist");
+        json addrs = json::parse(adressFile);
+
+        for (auto& [key, value] : addrs.items())
+            addresses[std::string(key)] = parseRegister(key, value);
+
+        if (config.contains("saveable_params"))
+            for (auto& item : config["saveable_params"])
+                if (addresses.find(std::string(item)) != addresses.end())
+                    saveable_params.insert(std::string(item));
+
+        if (config.contains("changeable_params"))
+            for (auto& item : config["changeable_params"])
+                if (addresses.find(std::string(item)) != addresses.end())
+                    changeable_params.insert(std::string(item));
+
+        if (config.contains("categorical_params"))
+            for (auto& [param, categs] : config["categorical_params"].items())
+            {
+                if (addresses.find(std::string(param)) == addresses.end())
+                    continue;
+
+                categorical_params[std::string(param)] = std::map<int, std::string>();
+                for (auto& [code, name] : categs.items())
+                    categorical_params[std::string(param)][std::stoul(std::string(code), nullptr, 16)] = std::string(name);
+            }
+
+        address_file = std::string(config["address_file"]);
+        return address_file;
+    }
+
+    // Modification time and size of a source file, the cache is stale when either changes
+    static std::pair<UINT64, UINT64> stamp(std::string path)
+    {
+        std::error_code error;
+        auto time = std::filesystem::last_write_time(path, error);
+        auto size = std::filesystem::file_size(path, error);
+        if (error)
+            return { 0, 0 };
+        return { (UINT64)time.time_since_epoch().count(), (UINT64)size };
+    }
+
+    bool loadCache(std::string dataDir, std::string cachePath)
+    {
+        MappedFile file;
+        if (!file.open(cachePath))
+            return false;
+
+        CacheReader in{ file.data(), file.data() + file.size() };
+        if (in.u64() != CACHE_MAGIC || in.u64() != stamp(dataDir + "config.json").first || in.u64() != stamp(dataDir + "config.json").second)
+            return false;
+        std::string addressFile = in.str();
+        address_file = addressFile;
+        auto addressStamp = stamp(dataDir + addressFile);
+        if (in.u64() != addressStamp.first || in.u64() != addressStamp.second || !in.ok)
+            return false;
+
+        for (UINT64 i = 0, n = in.u64(); i < n && in.ok; i++)
+        {
+            RegisterType& type = addresses[in.str()];
+            type.address = (BYTE)in.u64();
+            type.width = (BYTE)in.u64();
+            type.byteOrder = (BYTE)in.u64();
+            type.isSigned = in.u64() != 0;
+            type.scale.factor = in.f64();
+            type.scale.offset = in.f64();
+            type.scale.reciprocal = in.u64() != 0;
+        }
+        for (UINT64 i = 0, n = in.u64(); i < n && in.ok; i++)
+            saveable_params.insert(in.str());
+        for (UINT64 i = 0, n = in.u64(); i < n && in.ok; i++)
+            changeable_params.insert(in.str());
+        for (UINT64 i = 0, n = in.u64(); i < n && in.ok; i++)
+        {
+            auto& categs = categorical_params[in.str()];
+            for (UINT64 j = 0, m = in.u64(); j < m && in.ok; j++)
+            {
+                int code = (int)in.u64();
+                categs[code] = in.str();
+            }
+        }
+
+        if (!in.ok) // Truncated or corrupted cache, start over from the JSON files
+        {
+            addresses.clear();
+            saveable_params.clear();
+            changeable_params.clear();
+            categorical_params.clear();
+            return false;
+        }
+        return true;
+    }
+
+    void saveCache(std::string dataDir, std::string addressFile, std::string cachePath)
+    {
+        std::string out;
+        auto u64 = [&](UINT64 value) { out.append((const char*)&value, sizeof(value)); };
+        auto f64 = [&](double value) { out.append((const char*)&value, sizeof(value)); };
+        auto str = [&](const std::string& value) { u64(value.size()); out.append(value); };
+
+        auto configStamp = stamp(dataDir + "config.json");
+        auto addressStamp = stamp(dataDir + addressFile);
+        u64(CACHE_MAGIC);
+        u64(configStamp.first);
+        u64(configStamp.second);
+        str(addressFile);
+        u64(addressStamp.first);
+        u64(addressStamp.second);
+
+        u64(addresses.size());
+        for (auto& [param, type] : addresses)
+        {
+            str(param);
+            u64(type.address);
+            u64(type.width);
+            u64(type.byteOrder);
+            u64(type.isSigned);
+            f64(type.scale.factor);
+            f64(type.scale.offset);
+            u64(type.scale.reciprocal);
+        }
+        u64(saveable_params.size());
+        for (auto& param : saveable_params)
+            str(param);
+        u64(changeable_params.size());
+        for (auto& param : changeable_params)
+            str(param);
+        u64(categorical_params.size());
+        for (auto& [param, categs] : categorical_params)
+        {
+            str(param);
+            u64(categs.size());
+            for (auto& [code, name] : categs)
+            {
+                u64((UINT64)code);
+                str(name);
+            }
+        }
+
+        // Written aside and renamed, so a concurrent reader never maps a half-written cache
+        std::string tempPath = cachePath + ".tmp";
+        std::ofstream os(tempPath, std::ios::out | std::ios::binary);
+        os.write(out.data(), out.size());
+        os.close();
+
+        std::error_code error;
+        if (os)
+            std::filesystem::rename(tempPath, cachePath, error);
+        else
+            std::filesystem::remove(tempPath, error);
+    }
+
+#endif
+
+    static Config::Ptr instance()
+    {
+        static Config::Ptr _config = std::make_shared<Config>();
+        return _config;
+    }
+};
+
+// Config is parsed on first use, so commands that don't need it start instantly
+struct ConfigRef
+{
+    Config* operator->() const
+    {
+        return Config::instance().get();
+    }
+} config;
+
+struct ReadPlan
+{
+    EC_REGISTERS registers;
+
+    void add(ParamId id)
+    {
+        const ParamTable& params = config->params;
+        assert(id < params.size() && "ERROR: parameter not found");
+        for (BYTE i = 0; i < params.width[id]; i++)
+            registers.set(params.address[id] + i);
+    }
+
+    static ReadPlan all()
+    {
+        ReadPlan plan;
+        for (ParamId id = 0; id < config->params.size(); id++)
+            plan.add(id);
+        return plan;
+    }
+
+    static ReadPlan realtime()
+    {
+        ReadPlan plan;
+        for (ParamId id = 0; id < config->params.size(); id++)
+            if (config->params.realtime[id])
+                plan.add(id);
+        return plan;
+    }
+};
+
+// Register values to write, reduced to the registers that differ from a snapshot before applying
+struct WritePlan
+{
+    EC_REGISTERS registers;
+    std::array<BYTE, 0x100> values{};
+
+    void set(ParamId id, int value)
+    {
+        const ParamTable& params = config->params;
+        assert(id < params.size() && "ERROR: parameter not found");
+        BYTE width = params.width[id];
+        for (BYTE i = 0; i < width; i++)
+        {
+            BYTE reg = (BYTE)(params.address[id] + i);
+            registers.set(reg);
+            values[reg] = (BYTE)((UINT32)value >> (params.byteOrder[id] == BIG_ENDIAN ? (width - 1 - i) * 8 : i * 8));
+        }
+    }
+
+    ReadPlan reads() const
+    {
+        ReadPlan plan;
+        plan.registers = registers;
+        return plan;
+    }
+
+    // Drops the registers that already hold their value
+    void diff(const EC_DUMP& snapshot)
+    {
+        for (int reg = 0; reg < 0x100; reg++)
+            if (registers[reg] && snapshot.valid[reg] && snapshot[(BYTE)reg] == values[reg])
+                registers.reset(reg);
+    }
+};
+
+// Queueing latency of each priority class of the EC thread
+void PrintClassStats(const EcWorkerStats& stats)
+{
+    const char* names[EC_CLASSES] = { "safety", "realtime", "bulk" };
+    for (BYTE priority = 0; priority < EC_CLASSES; priority++)
+    {
+        const EC_HISTOGRAM& wait = stats.classes[priority].wait;
+        std::cout << "    " << names[priority] << ": " << wait.count << " started, " << stats.classes[priority].expired << " expired, "
+            << stats.classes[priority].refused << " refused on lock timeout";
+        if (wait.count)
+            std::cout << ", wait avg " << wait.totalNs / wait.count << "ns, p50 <" << wait.percentile(0.5) << "ns, p99 <"
+                << wait.percentile(0.99) << "ns, max " << wait.maxNs << "ns";
+        std::cout << std::endl;
+    }
+}
+
+class EmbeddedControllerWrapper
+{
+public:
+    typedef std::shared_ptr<EmbeddedControllerWrapper> Ptr;
+
+private:
+    std::shared_ptr<EmbeddedController> _ec;
+    EcLock _lock; // Keeps other processes off the EC ports during our transactions
+    std::unique_ptr<EcWorker> _worker; // Only thread allowed to touch _ec
+    std::unique_ptr<ReadCache> _cache; // Realtime reads, shared while in flight
+    EC_REGISTERS _sensors;             // Registers of realtime params only, the ones the cache may serve
+    const ParamTable* _params;
+    inline static EmbeddedControllerWrapper::Ptr _ecw;
+    inline static std::string _ramPath; // EC RAM file to use instead of the platform's default
+
+    EmbeddedControllerWrapper() : _params(&config->params)
+    {
+        auto begin = std::chrono::steady_clock::now();
+        _ec = std::make_shared<EmbeddedController>(defaultPortIo(_ramPath));
+        timings.driverOpen = std::chrono::steady_clock::now() - begin;
+
+        assert(_ec->driverFileExist && "ERROR: driver not found");
+        assert(_ec->driverLoaded && "ERROR: driver not loaded");
+        // Without the lock file or mutex, e.g. when the mutex belongs to another user, run unlocked as before
+        _worker = std::make_unique<EcWorker>(*_ec, _lock.open() ? &_lock : nullptr);
+        _cache = std::make_unique<ReadCache>(*_worker);
+
+        // A register shared with a curve or mode param is always read from the EC
+        EC_REGISTERS settings;
+        for (ParamId id = 0; id < _params->size(); id++)
+            if (!_params->realtime[id])
+                settings |= span(_params->address[id], _params->width[id]);
+        _sensors = ReadPlan::realtime().registers & ~settings;
+    }
+
+    // Only sensor registers are served from the read cache, the others, e.g. curves and modes, come from the EC.
+    // Both requests are queued back to back, so the EC thread reads whatever the cache misses in one pass.
+    EC_DUMP realtimeRead(const EC_REGISTERS& registers, EC_DEADLINE deadline)
+    {
+        EC_REGISTERS sensors = registers & _sensors;
+        EC_REGISTERS others = registers & ~_sensors;
+        if (others.none())
+            return _cache->read(sensors, deadline);
+
+        std::future<EC_DUMP> direct = _worker->read(others, EC_REALTIME, deadline);
+        if (sensors.none())
+            return direct.get();
+
+        EC_DUMP snapshot = _cache->read(sensors, deadline);
+        EC_DUMP rest = direct.get();
+        for (int reg = 0; reg < 0x100; reg++)
+            if (rest.valid[reg])
+                snapshot.values[reg] = rest.values[reg];
+        snapshot.valid |= rest.valid;
+        if (rest.timestamp < snapshot.timestamp)
+            snapshot.timestamp = rest.timestamp;
+        return snapshot;
+    }
+
+    static EC_REGISTERS span(BYTE address, BYTE width)
+    {
+        EC_REGISTERS registers;
+        for (BYTE i = 0; i < width; i++)
+            registers.set((BYTE)(address + i));
+        return registers;
+    }
+
+    void timeFirstRead(std::chrono::steady_clock::time_point begin)
+    {
+        if (timings.firstReadDone)
+            return;
+        timings.firstRead = std::chrono::steady_clock::now() - begin;
+        timings.firstReadDone = true;
+    }
+
+public:
+
+    // Layout of a param. With a compiled-in map it comes from the constant table,
+    // so for an id known at compile time, e.g. from PARAM(), address, width and order fold into constants.
+    RegisterType layout(ParamId id) const
+    {
+        assert(id < _params->size() && "ERROR: parameter not found");
+#ifdef FIXED_REGISTER_MAP
+        return regmap::PARAMS[id].type;
+#else
+        return { _params->address[id], _params->width[id], _params->byteOrder[id], _params->isSigned[id], _params->scale[id] };
+#endif
+    }
+
+    // Hot path: no string comparisons, a single request to the EC thread
+    int get(ParamId id)
+    {
+        RegisterType type = layout(id);
+        auto begin = std::chrono::steady_clock::now();
+        EC_REGISTERS registers = span(type.address, type.width);
+        EC_DUMP snapshot = realtimeRead(registers, EC_NO_DEADLINE);
+        timeFirstRead(begin);
+        if ((snapshot.valid & registers) != registers) // Failed reads are 0, as with readByte
+            return 0;
+        return get(id, snapshot);
+    }
+
+    // Whether every register of the param was read, a failed read must not pass for a value
+    bool valid(ParamId id, const EC_DUMP& snapshot)
+    {
+        RegisterType type = layout(id);
+        EC_REGISTERS registers = span(type.address, type.width);
+        return (snapshot.valid & registers) == registers;
+    }
+
+    // A param missing from the snapshot reads as 0, check valid() where that matters
+    int get(ParamId id, const EC_DUMP& snapshot)
+    {
+        if (!valid(id, snapshot))
+            return 0;
+        RegisterType type = layout(id);
+        UINT32 raw = 0;
+        for (BYTE i = 0; i < type.width; i++)
+            raw |= (UINT32)snapshot[(BYTE)(type.address + i)] << (type.byteOrder == BIG_ENDIAN ? (type.width - 1 - i) * 8 : i * 8);
+        return SignExtend(raw, type.width, type.isSigned);
+    }
+
+    // Value in the param's unit, after the scale declared in the address file
+    double value(ParamId id, const EC_DUMP& snapshot)
+    {
+        RegisterType type = layout(id);
+        int raw = get(id, snapshot);
+        return type.scale.apply(type.isSigned ? (double)raw : (double)(UINT32)raw);
+    }
+
+    // Verified write of a param, a value that doesn't take is rolled back
+    bool set(ParamId id, int value)
+    {
+        WritePlan plan;
+        plan.set(id, value);
+        // Diffed and rolled back to, so never from the read cache
+        EC_DUMP before = _worker->read(plan.registers, EC_SAFETY).get();
+        plan.diff(before);
+        EC_REGISTERS failed, unknown;
+        return apply(plan, before, failed, unknown);
+    }
+
+    // A read past its deadline comes back without valid registers, sensors read at realtime priority may come from the cache
+    EC_DUMP read(const ReadPlan& plan, BYTE priority = EC_REALTIME, EC_DEADLINE deadline = EC_NO_DEADLINE)
+    {
+        auto begin = std::chrono::steady_clock::now();
+        EC_DUMP snapshot = priority == EC_REALTIME ? realtimeRead(plan.registers, deadline) : _worker->read(plan.registers, priority, deadline).get();
+        timeFirstRead(begin);
+        return snapshot;
+    }
+
+    // Writes every register of the plan in one burst session
+    bool write(const WritePlan& plan)
+    {
+        // Before, so nobody is served the old values meanwhile, after for reads that started meanwhile
+        _cache->invalidate(plan.registers);
+        bool ok = _worker->write(plan.registers, plan.values).get();
+        _cache->invalidate(plan.registers);
+        return ok;
+    }
+
+    // Age up to which realtime reads are served from the registers last read, 0 to always read
+    void setFreshness(UINT32 freshnessMs)
+    {
+        _cache->setFreshness(freshnessMs);
+    }
+
+    // Writes the plan, then reads all written registers back in one pass.
+    // Returns the registers that don't hold their value, the readback decides even when the write reported a failure.
+    EC_REGISTERS verifiedWrite(const WritePlan& plan)
+    {
+        EC_REGISTERS failed;
+        if (plan.registers.none())
+            return failed;
+
+        // Queued together in one class, the readback runs right after the writes without a round trip in between
+        _cache->invalidate(plan.registers);
+        std::future<BOOL> written = _worker->write(plan.registers, plan.values);
+        EC_DUMP after = _worker->read(plan.registers, EC_SAFETY).get();
+        written.wait();
+        _cache->invalidate(plan.registers);
+        for (int reg = 0; reg < 0x100; reg++)
+            if (plan.registers[reg] && (!after.valid[reg] || after[(BYTE)reg] != plan.values[reg]))
+                failed.set(reg);
+        return failed;
+    }
+
+    // Writes the plan and verifies it. When a write failed or didn't stick, the values of before,
+    // the snapshot the plan was made from, are written back and verified the same way.
+    // Registers that failed are returned in failed, those the rollback didn't put back,
+    // or that had no value before to go back to, in unknown.
+    bool apply(const WritePlan& plan, const EC_DUMP& before, EC_REGISTERS& failed, EC_REGISTERS& unknown)
+    {
+        unknown.reset();
+        failed = verifiedWrite(plan);
+        if (failed.none())
+            return true;
+
+        WritePlan rollback;
+        for (int reg = 0; reg < 0x100; reg++)
+            if (plan.registers[reg] && before.valid[reg])
+            {
+                rollback.registers.set(reg);
+                rollback.values[reg] = before[(BYTE)reg];
+            }
+        unknown = (plan.registers & ~before.valid) | verifiedWrite(rollback);
+        return false;
+    }
+
+    UINT64 transactions()
+    {
+        UINT64 count = 0;
+        _worker->execute([&](EmbeddedController& ec) { count = ec.stats.transactions; }, EC_REALTIME, FALSE).wait();
+        return count;
+    }
+
+    void printStats()
+    {
+        _worker->execute([&](EmbeddedController& ec)
+        {
+            ec.printStats();
+            const EcWorkerStats& stats = _worker->stats();
+            std::cout << "ec thread: " << stats.requests << " requests in " << stats.batches << " batches (max " << stats.maxBatch
+                << "), " << stats.readPasses << " read passes, " << stats.coalesced << " reads coalesced, "
+                << stats.chunks << " bulk chunks, " << stats.preemptions << " preemptions, " << stats.unlocked << " unlocked safety batches" << std::endl;
+            PrintClassStats(stats);
+            const EcLockStats& lock = _lock.stats;
+            std::cout << "ec lock: " << lock.acquisitions << " acquisitions, " << lock.contended << " contended, " << lock.timeouts << " timeouts";
+            if (lock.wait.count)
+                std::cout << ", wait avg " << lock.wait.totalNs / lock.wait.count << "ns, p99 <" << lock.wait.percentile(0.99)
+                    << "ns, max " << lock.wait.maxNs << "ns";
+            std::cout << std::endl;
+            ReadCacheStats cache = _cache->stats();
+            std::cout << "read cache: " << cache.hits << " hits, " << cache.misses << " misses, " << cache.joined << " joined in flight" << std::endl;
+        }, EC_REALTIME, FALSE).wait();
+    }
+
+    EC_DUMP dump()
+    {
+        auto begin = std::chrono::steady_clock::now();
+        EC_DUMP snapshot = _worker->read(EC_REGISTERS().set(), EC_BULK).get();
+        timeFirstRead(begin);
+        return snapshot;
+    }
+
+    // Read in chunks on the EC thread, formatted here, so realtime reads run in between
+    void printDump()
+    {
+        EmbeddedController::printDump(dump());
+    }
+
+    void saveDump(std::string output)
+    {
+        EmbeddedController::saveDump(dump(), output);
+    }
+
+    // Run on a file of the 256 EC registers instead of the EC, e.g. a saved dump, before the first instance()
+    static void useRamFile(std::string path)
+    {
+        _ramPath = path;
+    }
+
+    static EmbeddedControllerWrapper::Ptr instance()
+    {
+        if (!_ecw)
+            _ecw = EmbeddedControllerWrapper::Ptr(new EmbeddedControllerWrapper());
+        return _ecw;
+    }
+
+    ~EmbeddedControllerWrapper()
+    {
+        _worker.reset();
+        if (_ec)
+            _ec->close();
+    }
+};
+
+// Set by Ctrl+C in modes that must clean up before exiting
+volatile std::sig_atomic_t interrupted = 0;
+
+void OnInterrupt(int)
+{
+    interrupted = 1;
+}
+
+class FanSpeedEditor
+{
+private:
+    // The driver is loaded on first EC access, commands that only use the config never load it
+    EmbeddedControllerWrapper::Ptr ecw()
+    {
+        return EmbeddedControllerWrapper::instance();
+    }
+
+public:
+
+    void Show()
+    {
+        const ParamTable& params = config->params;
+        std::vector<bool> used(params.size());
+
+        UINT64 transactions = ecw()->transactions();
+        EC_DUMP snapshot = ecw()->read(ReadPlan::all());
+
+        // A register that failed to read is shown as n/a instead of a made-up 0
+        auto show = [&](ParamId id, std::string unit) -> std::string
+        {
+            return ecw()->valid(id, snapshot) ? std::to_string(ecw()->get(id, snapshot)) + unit : "n/a";
+        };
+        auto showRpm = [&](ParamId id) -> std::string
+        {
+            return ecw()->valid(id, snapshot) ? std::to_string((int)ecw()->value(id, snapshot)) + "rpm" : "n/a";
+        };
+
+        auto keys_is_exist = [&](std::vector<ParamId> ids) -> bool
+        {
+            for (ParamId id : ids)
+                if (id == NO_PARAM)
+                    return false;
+            for (ParamId id : ids)
+                used[id] = true;
+            return true;
+        };
+
+        if (keys_is_exist({ PARAM("realtime_cpu_temp"), PARAM("realtime_cpu_fan_rpm"), PARAM("realtime_cpu_fan_speed") }))
+        {
+            std::string cpu_temp = show(PARAM("realtime_cpu_temp"), "C");
+            std::string cpu_fan = showRpm(PARAM("realtime_cpu_fan_rpm"));
+            std::string cpu_fan_prc = show(PARAM("realtime_cpu_fan_speed"), "%");
+
+            std::cout << "cpu: " << cpu_temp << ", " << cpu_fan << " (" << cpu_fan_prc << ")" << std::endl;
+        }
+
+        if (keys_is_exist({ PARAM("realtime_gpu_temp"), PARAM("realtime_gpu_fan_rpm"), PARAM("realtime_gpu_fan_speed") }))
+        {
+            std::string gpu_temp = show(PARAM("realtime_gpu_temp"), "C");
+            std::string gpu_fan = showRpm(PARAM("realtime_gpu_fan_rpm"));
+            std::string gpu_fan_prc = show(PARAM("realtime_gpu_fan_speed"), "%");
+
+            std::cout << "gpu: " << gpu_temp << ", " << gpu_fan << " (" << gpu_fan_prc << ")" << std::endl;
+        }
+
+        if (keys_is_exist({ PARAM("cpu_temp_t1"), PARAM("cpu_temp_t2"), PARAM("cpu_temp_t3"), PARAM("cpu_temp_t4"), PARAM("cpu_temp_t5"), PARAM("cpu_temp_t6"),
+            PARAM("cpu_fan_speed_t1"), PARAM("cpu_fan_speed_t2"), PARAM("cpu_fan_speed_t3"), PARAM("cpu_fan_speed_t4"), PARAM("cpu_fan_speed_t5"),
+            PARAM("cpu_fan_speed_t6"), PARAM("cpu_fan_speed_t7") }))
+        {
+            std::cout << "cpu_tmp_thr: " << "00C    ";
+            std::cout << show(PARAM("cpu_temp_t1"), "C") << "    ";
+            std::cout << show(PARAM("cpu_temp_t2"), "C") << "    ";
+            std::cout << show(PARAM("cpu_temp_t3"), "C") << "    ";
+            std::cout << show(PARAM("cpu_temp_t4"), "C") << "    ";
+            std::cout << show(PARAM("cpu_temp_t5"), "C") << "    ";
+            std::cout << show(PARAM("cpu_temp_t6"), "C") << "    ";
+            std::cout << std::endl;
+
+            std::cout << "cpu_fan_thr: " << "    ";
+            std::cout << show(PARAM("cpu_fan_speed_t1"), "%") << "    ";
+            std::cout << show(PARAM("cpu_fan_speed_t2"), "%") << "    ";
+            std::cout << show(PARAM("cpu_fan_speed_t3"), "%") << "    ";
+            std::cout << show(PARAM("cpu_fan_speed_t4"), "%") << "    ";
+            std::cout << show(PARAM("cpu_fan_speed_t5"), "%") << "    ";
+            std::cout << show(PARAM("cpu_fan_speed_t6"), "%") << "    ";
+            std::cout << show(PARAM("cpu_fan_speed_t7"), "%") << "    ";
+            std::cout << std::endl;
+        }
+
+        if (keys_is_exist({ PARAM("gpu_temp_t1"), PARAM("gpu_temp_t2"), PARAM("gpu_temp_t3"), PARAM("gpu_temp_t4"), PARAM("gpu_temp_t5"), PARAM("gpu_temp_t6"),
+            PARAM("gpu_fan_speed_t1"), PARAM("gpu_fan_speed_t2"), PARAM("gpu_fan_speed_t3"), PARAM("gpu_fan_speed_t4"), PARAM("gpu_fan_speed_t5"),
+            PARAM("gpu_fan_speed_t6"), PARAM("gpu_fan_speed_t7") }))
+        {
+            std::cout << "gpu_tmp_thr: " << "00C    ";
+            std::cout << show(PARAM("gpu_temp_t1"), "C") << "    ";
+            std::cout << show(PARAM("gpu_temp_t2"), "C") << "    ";
+            std::cout << show(PARAM("gpu_temp_t3"), "C") << "    ";
+            std::cout << show(PARAM("gpu_temp_t4"), "C") << "    ";
+            std::cout << show(PARAM("gpu_temp_t5"), "C") << "    ";
+            std::cout << show(PARAM("gpu_temp_t6"), "C") << "    ";
+            std::cout << std::endl;
+
+            std::cout << "gpu_fan_thr: " << "    ";
+            std::cout << show(PARAM("gpu_fan_speed_t1"), "%") << "    ";
+            std::cout << show(PARAM("gpu_fan_speed_t2"), "%") << "    ";
+            std::cout << show(PARAM("gpu_fan_speed_t3"), "%") << "    ";
+            std::cout << show(PARAM("gpu_fan_speed_t4"), "%") << "    ";
+            std::cout << show(PARAM("gpu_fan_speed_t5"), "%") << "    ";
+            std::cout << show(PARAM("gpu_fan_speed_t6"), "%") << "    ";
+            std::cout << show(PARAM("gpu_fan_speed_t7"), "%") << "    ";
+            std::cout << std::endl;
+        }
+
+        for (ParamId id = 0; id < params.size(); id++)
+        {
+            if (used[id])
+                continue;
+
+            std::cout << params.name[id] << ": " << FormatParam(id, snapshot) << std::endl;
+        }
+
+        std::cout << "ec_transactions: " << ecw()->transactions() - transactions << std::endl;
+    }
+
+    // Category label or scaled value of a param
+    std::string FormatParam(ParamId id, const EC_DUMP& snapshot)
+    {
+        if (!ecw()->valid(id, snapshot))
+            return "n/a";
+        if (const std::string* label = config->params.label(id, ecw()->get(id, snapshot)))
+            return *label;
+
+        double value = ecw()->value(id, snapshot);
+        if (value == (double)(long long)value)
+            return std::to_string((long long)value);
+        std::ostringstream os;
+        os << value;
+        return os.str();
+    }
+
+    // Temperatures that steer adaptive sampling
+    std::vector<ParamId> Temperatures()
+    {
+        std::vector<ParamId> ids;
+        for (ParamId id : { PARAM("realtime_cpu_temp"), PARAM("realtime_gpu_temp") })
+            if (id != NO_PARAM)
+                ids.push_back(id);
+        return ids;
+    }
+
+    // Samples the realtime params every intervalMs until interrupted, redrawing only the lines that changed.
+    // With maxIntervalMs above intervalMs, sampling slows down towards it while temperatures are flat.
+    void Watch(int intervalMs, int maxIntervalMs)
+    {
+        assert(intervalMs > 0 && "ERROR: watch interval must be positive");
+#ifdef _WIN32
+        HANDLE console = GetStdHandle(STD_OUTPUT_HANDLE);
+        DWORD mode = 0;
+        if (GetConsoleMode(console, &mode))
+            SetConsoleMode(console, mode | ENABLE_VIRTUAL_TERMINAL_PROCESSING);
+#endif
+        ReadPlan plan = ReadPlan::realtime();
+        if (plan.registers.none())
+            plan = ReadPlan::all();
+
+        std::vector<ParamId> ids;
+        for (ParamId id = 0; id < config->params.size(); id++)
+            if (plan.registers[config->params.address[id]])
+                ids.push_back(id);
+
+        std::vector<std::string> lines;
+        std::vector<ParamId> temperatureIds = Temperatures();
+        std::vector<double> temperatures(temperatureIds.size());
+        AdaptiveSampler sampler(intervalMs, maxIntervalMs);
+        auto start = std::chrono::steady_clock::now();
+        auto deadline = start;
+        UINT64 ticks = 0, totalTransactions = 0;
+        double jitterSumUs = 0, jitterMaxUs = 0;
+
+        while (true)
+        {
+            // Absolute deadlines, so a late tick doesn't shift the ones after it
+            std::this_thread::sleep_until(deadline);
+            double jitterUs = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - deadline).count();
+            UINT64 transactions = ecw()->transactions();
+            EC_DUMP snapshot = ecw()->read(plan);
+            transactions = ecw()->transactions() - transactions;
+
+            ticks++;
+            totalTransactions += transactions;
+            jitterSumUs += jitterUs;
+            if (jitterUs > jitterMaxUs)
+                jitterMaxUs = jitterUs;
+            double elapsed = std::chrono::duration<double>(snapshot.timestamp - start).count();
+
+            for (size_t i = 0; i < temperatureIds.size(); i++)
+                if (ecw()->valid(temperatureIds[i], snapshot)) // A failed read keeps the last temperature
+                    temperatures[i] = ecw()->value(temperatureIds[i], snapshot);
+            auto interval = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                std::chrono::duration<double, std::milli>(sampler.update(temperatures, elapsed * 1000)));
+
+            std::vector<std::string> next;
+            for (ParamId id : ids)
+                next.push_back(config->params.name[id] + ": " + FormatParam(id, snapshot));
+
+            char status[160];
+            snprintf(status, sizeof(status), "rate: %.2f Hz, jitter: %.0f us (mean %.0f us, max %.0f us), ec_transactions: %llu",
+                ticks > 1 && elapsed > 0 ? (ticks - 1) / elapsed : 0.0, jitterUs, jitterSumUs / ticks, jitterMaxUs,
+                (unsigned long long)transactions);
+            next.push_back(status);
+
+            if (maxIntervalMs > intervalMs)
+            {
+                // Saved against sampling at intervalMs all along
+                double minutes = ticks > 1 ? elapsed / 60 : 0;
+                snprintf(status, sizeof(status), "interval: %.0f ms, slope: %.2f C/s, ec_transactions/min: %.0f (saved %.0f)",
+                    sampler.interval(), sampler.slope(), minutes > 0 ? totalTransactions / minutes : 0.0,
+                    minutes > 0 ? sampler.skipped() * totalTransactions / ticks / minutes : 0.0);
+                next.push_back(status);
+            }
+
+            std::string out;
+            if (lines.empty())
+                for (const auto& line : next)
+                    out += line + "\n";
+            else
+                for (size_t i = 0; i < next.size(); i++)
+                {
+                    if (next[i] == lines[i])
+                        continue;
+                    // Up to the line, rewrite it, clear the rest of it, back down below the block
+                    std::string up = std::to_string(next.size() - i);
+                    out += "\x1b[" + up + "A\r" + next[i] + "\x1b[K\x1b[" + up + "B\r";
+                }
+            std::cout << out << std::flush;
+            lines = next;
+
+            deadline += interval;
+            auto now = std::chrono::steady_clock::now();
+            if (deadline < now) // Overran a whole interval, skip the missed ticks instead of bursting
+                deadline += (now - deadline) / interval * interval + interval;
+        }
+    }
+
+    // Appends the realtime params to a ring file of sizeMb every intervalMs until interrupted,
+    // slowing down towards maxIntervalMs while temperatures are flat
+    void Record(std::string fileName, double intervalMs, int sizeMb, double maxIntervalMs)
+    {
+        assert(intervalMs > 0 && "ERROR: record interval must be positive");
+        ReadPlan plan = ReadPlan::realtime();
+        const ParamTable& params = config->params;
+
+        std::vector<ParamId> ids;
+        std::vector<TelemetryChannel> channels;
+        for (ParamId id = 0; id < params.size(); id++)
+        {
+            if (!params.realtime[id] || channels.size() == TELEMETRY_MAX_CHANNELS)
+                continue;
+            TelemetryChannel channel;
+            strncpy(channel.name, params.name[id].c_str(), sizeof(channel.name) - 1);
+            channel.factor = params.scale[id].factor;
+            channel.offset = params.scale[id].offset;
+            channel.reciprocal = params.scale[id].reciprocal;
+            channel.isSigned = params.isSigned[id];
+            channels.push_back(channel);
+            ids.push_back(id);
+        }
+        assert(!ids.empty() && "ERROR: no realtime params to record");
+
+        TelemetryWriter writer;
+        bool created = writer.create(fileName, channels, (UINT64)sizeMb << 20);
+        assert(created && "ERROR: cannot create telemetry file");
+
+        int values[TELEMETRY_MAX_CHANNELS];
+        std::vector<ParamId> temperatureIds = Temperatures();
+        std::vector<double> temperatures(temperatureIds.size());
+        AdaptiveSampler sampler(intervalMs, maxIntervalMs);
+        UINT64 transactions = ecw()->transactions();
+        auto start = std::chrono::steady_clock::now();
+        auto deadline = start;
+        auto report = start;
+        while (true)
+        {
+            std::this_thread::sleep_until(deadline);
+            EC_DUMP snapshot = ecw()->read(plan);
+            if ((snapshot.valid & plan.registers) != plan.registers) // A failed read is dropped rather than recorded as 0
+            {
+                deadline += std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                    std::chrono::duration<double, std::milli>(sampler.interval()));
+                continue;
+            }
+            for (size_t i = 0; i < ids.size(); i++)
+                values[i] = ecw()->get(ids[i], snapshot);
+            writer.append((UINT64)std::chrono::duration_cast<std::chrono::nanoseconds>(snapshot.timestamp - start).count(), values);
+
+            double elapsed = std::chrono::duration<double>(snapshot.timestamp - start).count();
+            for (size_t i = 0; i < temperatureIds.size(); i++)
+                if (ecw()->valid(temperatureIds[i], snapshot)) // A failed read keeps the last temperature
+                    temperatures[i] = ecw()->value(temperatureIds[i], snapshot);
+            auto interval = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                std::chrono::duration<double, std::milli>(sampler.update(temperatures, elapsed * 1000)));
+
+            if (snapshot.timestamp - report >= std::chrono::seconds(1))
+            {
+                report = snapshot.timestamp;
+                std::cout << "\rsamples: " << writer.samples() << ", " << writer.samples() / elapsed << " Hz, "
+                    << (double)writer.bytes() / writer.samples() << " bytes/sample";
+                if (maxIntervalMs > intervalMs)
+                {
+                    // Saved against sampling at intervalMs all along
+                    double perSample = (double)(ecw()->transactions() - transactions) / writer.samples();
+                    std::cout << ", interval: " << sampler.interval() << " ms, saved " << sampler.skipped() * perSample / (elapsed / 60)
+                        << " ec_transactions/min   ";
+                }
+                std::cout << std::flush;
+            }
+
+            deadline += interval;
+            auto now = std::chrono::steady_clock::now();
+            if (deadline < now) // Overran a whole interval, skip the missed ticks instead of bursting
+                deadline += (now - deadline) / interval * interval + interval;
+        }
+    }
+
+    // Samples the realtime params like Record and publishes each sample to the shared segment,
+    // where any number of SnapshotReaders pick it up without touching the EC
+    void Publish(double intervalMs, double maxIntervalMs)
+    {
+        assert(intervalMs > 0 && "ERROR: publish interval must be positive");
+        ReadPlan plan = ReadPlan::realtime();
+        std::vector<ParamId> ids;
+        std::vector<std::string> names;
+        for (ParamId id = 0; id < config->params.size(); id++)
+            if (config->params.realtime[id] && ids.size() < TELEMETRY_MAX_CHANNELS)
+            {
+                ids.push_back(id);
+                names.push_back(config->params.name[id]);
+            }
+        assert(!ids.empty() && "ERROR: no realtime params to publish");
+
+        SnapshotPublisher publisher;
+        bool created = publisher.create(names);
+        assert(created && "ERROR: cannot create shared segment");
+        std::cout << "Publishing to " << SharedSnapshotPath() << std::endl;
+
+        int raw[TELEMETRY_MAX_CHANNELS];
+        double values[TELEMETRY_MAX_CHANNELS];
+        std::vector<ParamId> temperatureIds = Temperatures();
+        std::vector<double> temperatures(temperatureIds.size());
+        AdaptiveSampler sampler(intervalMs, maxIntervalMs);
+        auto start = std::chrono::steady_clock::now();
+        auto deadline = start;
+        auto report = start;
+        UINT64 samples = 0;
+        while (true)
+        {
+            std::this_thread::sleep_until(deadline);
+            EC_DUMP snapshot = ecw()->read(plan);
+            if ((snapshot.valid & plan.registers) != plan.registers) // Readers keep the last complete sample
+            {
+                deadline += std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                    std::chrono::duration<double, std::milli>(sampler.interval()));
+                continue;
+            }
+            for (size_t i = 0; i < ids.size(); i++)
+            {
+                raw[i] = ecw()->get(ids[i], snapshot);
+                values[i] = ecw()->value(ids[i], snapshot);
+            }
+            publisher.publish(raw, values);
+            samples++;
+
+            double elapsed = std::chrono::duration<double>(snapshot.timestamp - start).count();
+            for (size_t i = 0; i < temperatureIds.size(); i++)
+                if (ecw()->valid(temperatureIds[i], snapshot)) // A failed read keeps the last temperature
+                    temperatures[i] = ecw()->value(temperatureIds[i], snapshot);
+            auto interval = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                std::chrono::duration<double, std::milli>(sampler.update(temperatures, elapsed * 1000)));
+
+            if (snapshot.timestamp - report >= std::chrono::seconds(1))
+            {
+                report = snapshot.timestamp;
+                std::cout << "\rsamples: " << samples << ", " << samples / elapsed << " Hz, interval: " << sampler.interval() << " ms   "
+                    << std::flush;
+            }
+
+            deadline += interval;
+            auto now = std::chrono::steady_clock::now();
+            if (deadline < now) // Overran a whole interval, skip the missed ticks instead of bursting
+                deadline += (now - deadline) / interval * interval + interval;
+        }
+    }
+
+    // Drives the cpu and gpu fan curves from the realtime temperatures every periodMs until interrupted,
+    // then puts back the curves and fan mode it started with
+    void Control(double target, int periodMs)
+    {
+        assert(periodMs > 0 && "ERROR: control period must be positive");
+        const ParamTable& params = config->params;
+        FanControlSettings settings;
+        settings.target = target;
+        settings.critical = target + 20;
+        settings.minDuty = 20; // Fans never stop while under control
+
+        struct Loop
+        {
+            std::string fan;
+            ParamId temperature;
+            std::vector<ParamId> curve;
+            FanController controller;
+            UINT64 failedWrites = 0;
+        };
+        std::vector<Loop> loops;
+        for (std::string fan : { "cpu", "gpu" })
+        {
+            Loop loop{ fan, params.id("realtime_" + fan + "_temp"), {}, FanController(settings) };
+            for (int i = 1; i <= 7; i++)
+            {
+                ParamId point = params.id(fan + "_fan_speed_t" + std::to_string(i));
+                if (point != NO_PARAM && params.changeable[point])
+                    loop.curve.push_back(point);
+            }
+            if (loop.temperature != NO_PARAM && loop.curve.size() == 7)
+                loops.push_back(loop);
+        }
+        assert(!loops.empty() && "ERROR: no fan curve to control");
+
+        // Everything restored on exit, read once
+        ParamId fanMode = PARAM("fan_mode");
+        ReadPlan restorePlan, temperatures;
+        for (const auto& loop : loops)
+        {
+            temperatures.add(loop.temperature);
+            for (ParamId point : loop.curve)
+                restorePlan.add(point);
+        }
+        if (fanMode != NO_PARAM)
+            restorePlan.add(fanMode);
+        EC_DUMP initial = ecw()->read(restorePlan, EC_SAFETY);
+        // Nothing is changed unless all of it can be put back
+        if ((initial.valid & restorePlan.registers) != restorePlan.registers)
+        {
+            std::cout << "ERROR: fan curves or fan mode could not be read, not taking control\n";
+            return;
+        }
+
+        // In Advanced mode the EC follows the curves, a flat curve holds the fan at the controller's duty
+        int advanced = fanMode != NO_PARAM ? params.code(fanMode, "Advanced") : -1;
+        if (advanced != -1 && !ecw()->set(fanMode, advanced))
+        {
+            std::cout << "ERROR: fan mode could not be set to Advanced, not taking control\n";
+            return;
+        }
+
+        interrupted = 0;
+        std::signal(SIGINT, OnInterrupt);
+
+        auto period = std::chrono::milliseconds(periodMs);
+        auto start = std::chrono::steady_clock::now();
+        auto deadline = start;
+        UINT64 ticks = 0, overruns = 0, missed = 0;
+        double tickSumUs = 0, tickMaxUs = 0;
+        while (!interrupted)
+        {
+            std::this_thread::sleep_until(deadline);
+            auto tickStart = std::chrono::steady_clock::now();
+            // A temperature the next tick would read again is useless, the read may wait one period at most
+            EC_DUMP snapshot = ecw()->read(temperatures, EC_REALTIME, tickStart + period);
+            if ((snapshot.valid & temperatures.registers) != temperatures.registers)
+            {
+                missed++;
+                deadline += period;
+                continue;
+            }
+            UINT64 nowMs = (UINT64)std::chrono::duration_cast<std::chrono::milliseconds>(snapshot.timestamp - start).count();
+
+            for (auto& loop : loops)
+            {
+                double temperature = ecw()->value(loop.temperature, snapshot);
+                int duty;
+                if (!loop.controller.update(temperature, nowMs, duty))
+                    continue;
+
+                WritePlan plan;
+                for (ParamId point : loop.curve)
+                    plan.set(point, duty);
+                // Only a duty that reached the EC counts as written, a failed one is tried again next tick
+                if (!ecw()->write(plan))
+                {
+                    loop.failedWrites++;
+                    std::cout << loop.fan << ": " << temperature << "C -> " << duty << "% write failed" << std::endl;
+                    continue;
+                }
+                loop.controller.commit(duty, nowMs);
+                std::cout << loop.fan << ": " << temperature << "C -> " << duty << "%" << std::endl;
+            }
+
+            double tickUs = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - tickStart).count();
+            ticks++;
+            tickSumUs += tickUs;
+            if (tickUs > tickMaxUs)
+                tickMaxUs = tickUs;
+
+            deadline += period;
+            auto now = std::chrono::steady_clock::now();
+            if (deadline < now) // Overran a whole period, skip the missed ticks instead of bursting
+            {
+                overruns++;
+                deadline += (now - deadline) / period * period + period;
+            }
+        }
+        std::signal(SIGINT, SIG_DFL);
+
+        WritePlan restore;
+        for (const auto& loop : loops)
+            for (ParamId point : loop.curve)
+                if (ecw()->valid(point, initial))
+                    restore.set(point, ecw()->get(point, initial));
+        if (advanced != -1 && ecw()->valid(fanMode, initial))
+            restore.set(fanMode, ecw()->get(fanMode, initial));
+        if (ecw()->write(restore))
+            std::cout << "\nRestored fan curves" << std::endl;
+        else
+            std::cout << "\nERROR: fan curves or fan mode could not be restored, check them with -p" << std::endl;
+        std::cout << "ticks: " << ticks << ", tick latency: mean " << (ticks ? tickSumUs / ticks : 0) << "us, max " << tickMaxUs
+            << "us, overruns: " << overruns << ", missed reads: " << missed << std::endl;
+        for (auto& loop : loops)
+            std::cout << loop.fan << ": " << loop.controller.writes << " writes, " << loop.controller.hysteresisSkips << " inside hysteresis, "
+                << loop.controller.rateLimitSkips << " rate limited, " << loop.failedWrites << " failed" << std::endl;
+    }
+
+    void Dump(std::string fileName = "")
+    {
+        if (fileName.empty())
+            ecw()->printDump();
+        else
+        {
+            ecw()->saveDump(fileName);
+            std::cout << "Dump saved\n";
+        }
+    }
+
+    void ShowStats()
+    {
+        ecw()->printStats();
+    }
+
+    void ShowChangeableParams()
+    {
+        for (ParamId id = 0; id < config->params.size(); id++)
+            if (config->params.changeable[id])
+                std::cout << config->params.name[id] << std::endl;
+    }
+
+    // A number or a label of the param, any int is a valid value since signed params can be negative
+    bool ParseParamValue(ParamId id, std::string paramValue, int& value)
+    {
+        try
+        {
+            value = std::stoi(paramValue);
+            return true;
+        }
+        catch (...)
+        {
+            value = config->params.code(id, paramValue);
+            return value != -1;
+        }
+    }
+
+    // Changeable param by name, NO_PARAM for unknown and read-only ones
+    ParamId ChangeableParam(std::string paramName)
+    {
+        ParamId id = config->params.id(paramName);
+        return id != NO_PARAM && config->params.changeable[id] ? id : NO_PARAM;
+    }
+
+    bool IsValidParam(std::string paramName, std::string paramValue)
+    {
+        ParamId id = ChangeableParam(paramName);
+        int value;
+        return id != NO_PARAM && ParseParamValue(id, paramValue, value);
+    }
+
+    void SetParam(std::string paramName, std::string paramValue)
+    {
+        std::cout << paramName << ": " << paramValue << " | ";
+        ParamId id = ChangeableParam(paramName);
+        assert(id != NO_PARAM && "ERROR: parameter not found");
+
+        int paramValueInt;
+        bool parsed = ParseParamValue(id, paramValue, paramValueInt);
+        assert(parsed && "ERROR: parameter label not found");
+
+        WritePlan plan;
+        plan.set(id, paramValueInt);
+        // Diffed and rolled back to, so never from the read cache
+        EC_DUMP snapshot = ecw()->read(plan.reads(), EC_SAFETY);
+        plan.diff(snapshot);
+
+        EC_REGISTERS failed, unknown;
+        if (plan.registers.none())
+            std::cout << "NOT CHANGED" << std::endl;
+        else if (ecw()->apply(plan, snapshot, failed, unknown))
+            std::cout << "LOADED" << std::endl;
+        else if (unknown.none())
+            std::cout << "FAILED, RESTORED" << std::endl;
+        else
+            std::cout << "FAILED, NOT RESTORED" << std::endl;
+    }
 
-        std::string configPath = dataDir + "config.json";
-        std::ifstream configFile(configPath);
-        assert(configFile.is_open() && "Config file does not exist");
-        json config = json::parse(configFile);
+    void Save(std::string profileName = "profile.ini")
+    {
+        std::ofstream os(profileName);
+        Save(os);
+        os.close();
+        std::cout << "Save success\n";
+    }
 
-        assert(config.contains("address_file") && "address_file option does not exist in config");
-        std::string adressPath = dataDir + std::string(config["address_file"]);
-        std::ifstream adressFile(adressPath);
-        assert(adressFile.is_open() && "Adress file does not exist");
-        json addrs = json::parse(adressFile);
+    void Save(std::ostream& os)
+    {
+        const ParamTable& params = config->params;
+        ReadPlan plan;
+        for (ParamId id = 0; id < params.size(); id++)
+            if (params.saveable[id])
+                plan.add(id);
+        EC_DUMP snapshot = ecw()->read(plan, EC_SAFETY);
 
-        for (auto& [key, value] : addrs.items())
+        for (ParamId id = 0; id < params.size(); id++)
         {
-            if (addrs[key].is_array())
+            if (!params.saveable[id])
+                continue;
+            // A param that failed to read is left out, loading the profile keeps its current value
+            if (!ecw()->valid(id, snapshot))
+            {
+                std::cout << "ERROR: " << params.name[id] << " could not be read, left out of the profile\n";
+                continue;
+            }
+            os << params.name[id] << '\n';
+            auto paramValue = ecw()->get(id, snapshot);
+            if (const std::string* label = params.label(id, paramValue))
             {
-                assert(addrs[key].size() == 2 && "array type params can only have size equal to two");
-                addresses[std::string(key)] = -2;
-                addresses_dual[std::string(key) + "_b1"] = std::stoul(std::string(value[0]), nullptr, 16);
-                addresses_dual[std::string(key) + "_b2"] = std::stoul(std::string(value[1]), nullptr, 16);
+                os << *label << '\n';
             }
             else
             {
-                addresses[std::string(key)] = std::stoul(std::string(value), nullptr, 16);
+                os << paramValue << '\n';
             }
         }
+    }
 
-        if (config.contains("saveable_params"))
-            for (auto& item : config["saveable_params"])
-                if (addresses.find(std::string(item)) != addresses.end())
-                    saveable_params.insert(std::string(item));
+    void Load(std::string profileName = "profile.ini")
+    {
+        std::ifstream profileFile(profileName, std::ios::in);
+        assert(profileFile.is_open() && "Adress file does not exist");
+        Load(profileFile);
+    }
 
-        if (config.contains("changeable_params"))
-            for (auto& item : config["changeable_params"])
-                if (addresses.find(std::string(item)) != addresses.end())
-                    changeable_params.insert(std::string(item));
+    // One sparse read of the profile's registers, then only the registers that differ are written
+    void Load(std::istream& profile)
+    {
+        std::vector<std::pair<ParamId, int>> entries;
+        std::vector<std::string> names, values;
+        std::string paramName, paramValue;
+        WritePlan plan;
+        while (profile >> paramName >> paramValue)
+        {
+            ParamId id = ChangeableParam(paramName);
+            assert(id != NO_PARAM && "ERROR: parameter not found");
+            int paramValueInt;
+            bool parsed = ParseParamValue(id, paramValue, paramValueInt);
+            assert(parsed && "ERROR: parameter label not found");
 
-        if (config.contains("categorical_params"))
-            for (auto& [param, categs] : config["categorical_params"].items())
-            {
-                if (addresses.find(std::string(param)) == addresses.end())
-                    continue;
+            plan.set(id, paramValueInt);
+            entries.push_back({ id, paramValueInt });
+            names.push_back(paramName);
+            values.push_back(paramValue);
+        }
 
-                categorical_params[std::string(param)] = std::map<int, std::string>();
-                for (auto& [code, name] : categs.items())
-                    categorical_params[std::string(param)][std::stoul(std::string(code), nullptr, 16)] = std::string(name);
-            }
+        UINT64 transactions = ecw()->transactions();
+        EC_DUMP snapshot = ecw()->read(plan.reads(), EC_SAFETY);
+        UINT64 reads = ecw()->transactions() - transactions;
+        for (size_t i = 0; i < entries.size(); i++)
+        {
+            bool changed = !ecw()->valid(entries[i].first, snapshot) || ecw()->get(entries[i].first, snapshot) != entries[i].second;
+            std::cout << names[i] << ": " << values[i] << " | " << (changed ? "LOADED" : "NOT CHANGED") << std::endl;
+        }
+
+        plan.diff(snapshot);
+        transactions = ecw()->transactions();
+        EC_REGISTERS failed, unknown;
+        bool applied = ecw()->apply(plan, snapshot, failed, unknown);
+        if (!applied)
+        {
+            for (int reg = 0; reg < 0x100; reg++)
+                if (failed[reg])
+                {
+                    char message[64];
+                    snprintf(message, sizeof(message), "ERROR: register 0x%02X did not take 0x%02X", reg, plan.values[reg]);
+                    std::cout << message << "\n";
+                }
+            for (int reg = 0; reg < 0x100; reg++)
+                if (unknown[reg])
+                {
+                    char message[64];
+                    snprintf(message, sizeof(message), "ERROR: register 0x%02X could not be restored", reg);
+                    std::cout << message << "\n";
+                }
+            std::cout << (unknown.none() ? "Load failed, previous values restored\n" : "Load failed, registers above are in an unknown state\n");
+            return;
+        }
+
+        // apply() verifies in a single readback pass, its handshakes are whatever is left after the writes
+        UINT64 verifyReads = ecw()->transactions() - transactions - plan.registers.count();
+        std::cout << "Load success, ec reads: " << reads << ", register writes: " << plan.registers.count();
+        if (plan.registers.any())
+            std::cout << ", verification: 1 pass of " << verifyReads << " register reads";
+        std::cout << "\n";
     }
 };
 
-std::shared_ptr<Config> config = std::make_shared<Config>();
-
-class EmbeddedControllerWrapper
+// Emits the loaded register map as a header for builds with -DFIXED_REGISTER_MAP
+void GenerateRegisterMap(std::string output)
 {
-public:
-    typedef std::shared_ptr<EmbeddedControllerWrapper> Ptr;
-
-private:
-    std::shared_ptr<EmbeddedController> _ec;
-    inline static EmbeddedControllerWrapper::Ptr _ecw;
+    std::string model = std::filesystem::path(config->address_file).stem().string();
+    if (output.empty())
+        output = "data/" + model + ".hpp";
 
-    EmbeddedControllerWrapper()
+    auto quote = [](const std::string& value)
     {
-        _ec = std::make_shared<EmbeddedController>();
+        std::string quoted = "\"";
+        for (char c : value)
+        {
+            if (c == '"' || c == '\\')
+                quoted += '\\';
+            quoted += c;
+        }
+        return quoted + "\"";
+    };
 
-        assert(_ec->driverFileExist && "ERROR: driver not found");
-        assert(_ec->driverLoaded && "ERROR: driver not loaded");
-    }
+    const ParamTable& params = config->params;
+    std::ostringstream os;
+    os << "// Generated by fan_speed_editor -gen from " << config->address_file << ", do not edit\n";
+    os << "#pragma once\n\n";
+    os << "namespace regmap\n{\n";
+    os << "constexpr const char* MODEL = " << quote(model) << ";\n";
+    os << "constexpr const char* ADDRESS_FILE = " << quote(config->address_file) << ";\n\n";
 
-public:
+    os.precision(17);
+    os << "// name, { address, width, byte order, signed, { scale factor, offset, reciprocal } }, saveable, changeable\n";
+    os << "constexpr RegisterDescriptor PARAMS[] = {\n";
+    for (ParamId id = 0; id < params.size(); id++)
+    {
+        const std::string& name = params.name[id];
+        char address[8];
+        snprintf(address, sizeof(address), "0x%02X", params.address[id]);
+        const Scale& scale = params.scale[id];
+        os << "    { " << quote(name) << ", { " << address << ", " << (int)params.width[id] << ", "
+           << (params.byteOrder[id] == BIG_ENDIAN ? "BIG_ENDIAN" : "LITTLE_ENDIAN") << ", "
+           << (params.isSigned[id] ? "true" : "false") << ", { "
+           << scale.factor << ", " << scale.offset << ", " << (scale.reciprocal ? "true" : "false") << " } }, "
+           << (params.saveable[id] ? "true" : "false") << ", "
+           << (params.changeable[id] ? "true" : "false") << " },\n";
+    }
+    os << "};\n\n";
 
-    int getParam(std::string param)
+    os << "// param index, code, label\n";
+    os << "constexpr CategoryLabel CATEGORIES[] = {\n";
+    bool empty = true;
+    for (ParamId id = 0; id < params.size(); id++)
     {
-        assert(config->addresses.find(param) != config->addresses.end() && "ERROR: parameter not found");
-        if (config->addresses[param] != -2)
-        {
-            return (int)_ec->readByte(config->addresses[param]);
-        }
-        else
+        if (params.category[id] < 0)
+            continue;
+        for (auto& [code, label] : params.categories[params.category[id]])
         {
-            assert(config->addresses_dual.find(param + "_b1") != config->addresses_dual.end() && "ERROR: parameter not found");
-            assert(config->addresses_dual.find(param + "_b2") != config->addresses_dual.end() && "ERROR: parameter not found");
-            int v1 = (int)_ec->readByte(config->addresses_dual[param + "_b1"]);
-            int v2 = (int)_ec->readByte(config->addresses_dual[param + "_b2"]);
-            return (v1 << 8) | v2;
+            char value[8];
+            snprintf(value, sizeof(value), "0x%02X", code);
+            os << "    { " << id << ", " << value << ", " << quote(label) << " },\n";
+            empty = false;
         }
     }
+    if (empty) // Arrays can't be empty
+        os << "    { NO_PARAM, 0, \"\" },\n";
+    os << "};\n";
+    os << "}\n";
+
+    std::ofstream header(output, std::ios::out | std::ios::binary);
+    assert(header.is_open() && "ERROR: cannot create register map header");
+    header << os.str();
+    std::cout << "Register map written to " << output << "\n";
+}
+
+void Benchmark(int count)
+{
+    SimulatedLatency latency;
+    latency.scNs = 1000;
+    latency.dataNs = 1000;
+    latency.ibfPolls = 1;
+    latency.obfPolls = 1;
+
+    auto sim = std::make_shared<SimulatedEc>(latency);
+    EmbeddedController ec(sim);
+    for (int i = 0; i < 0x100; i++)
+        sim->poke(i, (BYTE)i);
+
+    std::cout << "simulated EC: " << latency.scNs << "ns/sc, " << latency.dataNs << "ns/data, "
+        << latency.ibfPolls << " ibf polls, " << latency.obfPolls << " obf polls" << std::endl;
 
-    void setParam(std::string paramName, int paramValue)
+    auto run = [&](const char* name, int ops, auto&& op)
     {
-        _ec->writeByte(config->addresses[paramName], (BYTE)paramValue);
-    }
+        UINT64 accesses = sim->portReads + sim->portWrites;
+        auto begin = std::chrono::steady_clock::now();
+        for (int i = 0; i < ops; i++)
+            op(i);
+        auto elapsed = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - begin).count();
+        accesses = sim->portReads + sim->portWrites - accesses;
 
-    static EmbeddedControllerWrapper::Ptr instance()
+        std::cout << name << ": " << ops << " ops, " << elapsed / ops << "us/op, "
+            << (double)accesses / ops << " port accesses/op" << std::endl;
+    };
+
+    run("readByte", count, [&](int i) { assert(ec.readByte((BYTE)i) == (BYTE)i && "ERROR: simulated read mismatch"); });
+    run("writeByte", count, [&](int i) { ec.writeByte((BYTE)i, (BYTE)i); });
+
+    for (BOOL burst : { FALSE, TRUE })
     {
-        if (!_ecw)
-            _ecw = EmbeddedControllerWrapper::Ptr(new EmbeddedControllerWrapper());
-        return _ecw;
+        ec.useBurst = burst;
+        std::string mode = burst ? " (burst)" : "";
+        run(("readDword" + mode).c_str(), count / 4, [&](int i) { ec.readDword((BYTE)(i * 4)); });
+        run(("writeDword" + mode).c_str(), count / 4, [&](int i) { ec.writeDword((BYTE)(i * 4), (DWORD)i); });
+        run(("dump" + mode).c_str(), count / 0x100 + 1, [&](int) { assert(ec.dump().valid.all() && "ERROR: simulated dump failed"); });
     }
 
-    ~EmbeddedControllerWrapper()
+    // Recorder: 6 realtime-like channels, temperatures and duty drifting by small steps
+    BYTE registers[] = { 0x68, 0x71, 0x80, 0x89, 0xC8, 0xCA };
+    EC_REGISTERS plan;
+    std::vector<TelemetryChannel> channels(6);
+    for (int i = 0; i < 6; i++)
     {
-        if (_ec)
-            _ec->close();
+        plan.set(registers[i]);
+        snprintf(channels[i].name, sizeof(channels[i].name), "r%02X", registers[i]);
     }
-};
 
-class FanSpeedEditor
-{
-private:
-    EmbeddedControllerWrapper::Ptr _ecw;
+    std::string path = (std::filesystem::temp_directory_path() / "fan_speed_editor_bench.telemetry").string();
+    TelemetryWriter writer;
+    bool created = writer.create(path, channels, 1 << 20);
+    assert(created && "ERROR: cannot create telemetry file");
 
-public:
-    FanSpeedEditor() : _ecw(EmbeddedControllerWrapper::instance())
+    ec.useBurst = TRUE;
+    int values[6];
+    double encodeUs = 0;
+    unsigned seed = 1;
+    auto begin = std::chrono::steady_clock::now();
+    for (int i = 0; i < count; i++)
     {
+        seed = seed * 1103515245 + 12345;
+        BYTE reg = registers[(seed >> 16) % 6];
+        sim->poke(reg, (BYTE)(sim->peek(reg) + ((seed >> 8) & 2) - 1));
 
+        EC_DUMP snapshot = ec.dump(plan);
+        auto encode = std::chrono::steady_clock::now();
+        for (int c = 0; c < 6; c++)
+            values[c] = snapshot[registers[c]];
+        writer.append((UINT64)std::chrono::duration_cast<std::chrono::nanoseconds>(snapshot.timestamp - begin).count(), values);
+        encodeUs += std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - encode).count();
     }
+    auto elapsed = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - begin).count();
 
-    void Show()
+    UINT64 decoded = 0;
+    TelemetryReader reader;
+    if (reader.open(path))
+        reader.scan([&](UINT64, const int*) { decoded++; });
+    std::cout << "record: " << count << " samples, " << elapsed / count << "us/sample (" << encodeUs / count << "us encoding), "
+        << (double)writer.bytes() / writer.samples() << " bytes/sample, " << decoded << " kept in 1 MiB" << std::endl;
+    writer.close();
+    std::error_code error;
+    std::filesystem::remove(path, error);
+
+    // EC thread: producers reading single registers at once, adjacent reads in its queue share a pass
     {
-        std::set<std::string> used_params;
+        EcWorker worker(ec);
+        int producers = 4;
+        std::vector<std::thread> threads;
+        auto begin = std::chrono::steady_clock::now();
+        for (int t = 0; t < producers; t++)
+            threads.emplace_back([&, t]()
+            {
+                for (int i = t; i < count; i += producers)
+                {
+                    EC_DUMP snapshot = worker.read(EC_REGISTERS().set((BYTE)i)).get();
+                    assert(snapshot.valid[(BYTE)i] && "ERROR: simulated read failed");
+                }
+            });
+        for (auto& thread : threads)
+            thread.join();
+        auto elapsed = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - begin).count();
 
-        auto keys_is_exist = [&](std::vector<std::string> param_list) -> bool
-        {
-            for (const auto& p : param_list)
-                if (config->addresses.find(p) == config->addresses.end())
-                    return false;
-            for (const auto& p : param_list)
-                used_params.insert(p);
-            return true;
-        };
+        const EcWorkerStats& stats = worker.stats();
+        std::cout << "ec thread: " << producers << " producers, " << count << " reads, " << elapsed / count << "us/read, "
+            << (double)stats.requests / stats.readPasses << " reads/pass" << std::endl;
+    }
 
-        if(keys_is_exist({ "realtime_cpu_temp" , "realtime_cpu_fan_rpm" , "realtime_cpu_fan_speed" }))
-        {
-            int cpu_temp = _ecw->getParam("realtime_cpu_temp");
-            int cpu_fan = _ecw->getParam("realtime_cpu_fan_rpm");
-            int cpu_fan_prc = _ecw->getParam("realtime_cpu_fan_speed");
+    // Read cache: producers all polling the same temperature, sharing reads in flight, then within 1ms
+    for (UINT32 freshnessMs : { 0, 1 })
+    {
+        EcWorker worker(ec);
+        ReadCache cache(worker, freshnessMs);
+        int producers = 4;
+        std::vector<std::thread> threads;
+        UINT64 transactions = ec.stats.transactions;
+        auto begin = std::chrono::steady_clock::now();
+        for (int t = 0; t < producers; t++)
+            threads.emplace_back([&]()
+            {
+                for (int i = 0; i < count / producers; i++)
+                    assert(cache.read(EC_REGISTERS().set(0x68)).valid[0x68] && "ERROR: simulated read failed");
+            });
+        for (auto& thread : threads)
+            thread.join();
+        auto elapsed = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - begin).count();
 
-            cpu_fan = cpu_fan ? 478000 / cpu_fan : 0;
-            std::cout << "cpu: " << cpu_temp << "C, " << cpu_fan << "rpm (" << cpu_fan_prc << "%)" << std::endl;
-        }
+        ReadCacheStats stats = cache.stats();
+        std::cout << "read cache (" << freshnessMs << "ms): " << count << " reads, " << elapsed / count << "us/read, "
+            << stats.hits << " hits, " << stats.misses << " misses, " << stats.joined << " joined, "
+            << ec.stats.transactions - transactions << " transactions" << std::endl;
+    }
 
-        if (keys_is_exist({ "realtime_gpu_temp" , "realtime_gpu_fan_rpm" , "realtime_gpu_fan_speed" }))
-        {
-            int gpu_temp = _ecw->getParam("realtime_gpu_temp");
-            int gpu_fan = _ecw->getParam("realtime_gpu_fan_rpm");
-            int gpu_fan_prc = _ecw->getParam("realtime_gpu_fan_speed");
+    // Two instances on one EC, standing in for two processes, take turns per batch through the system-wide lock
+    {
+#ifdef _WIN32
+        std::string name = "Local\\fan_speed_editor_bench";
+#else
+        std::string name = (std::filesystem::temp_directory_path() / "fan_speed_editor_bench.lock").string();
+#endif
+        EcLock locks[2] = { EcLock(name), EcLock(name) };
+        bool opened = locks[0].open() && locks[1].open();
+        assert(opened && "ERROR: cannot open bench lock");
+        EcWorker first(ec, &locks[0]), second(ec, &locks[1]);
+        EcWorker* workers[2] = { &first, &second };
 
-            gpu_fan = gpu_fan ? 478000 / gpu_fan : 0;
-            std::cout << "gpu: " << gpu_temp << "C, " << gpu_fan << "rpm (" << gpu_fan_prc << "%)" << std::endl;
-        }
+        std::vector<std::thread> threads;
+        auto begin = std::chrono::steady_clock::now();
+        for (int t = 0; t < 2; t++)
+            threads.emplace_back([&, t]()
+            {
+                for (int i = 0; i < count / 8; i++)
+                {
+                    EC_REGISTERS registers;
+                    for (int r = 0; r < 4; r++)
+                        registers.set((BYTE)(i * 4 + r));
+                    assert(workers[t]->read(registers).get().valid.count() == 4 && "ERROR: simulated read failed");
+                }
+            });
+        for (auto& thread : threads)
+            thread.join();
+        auto elapsed = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - begin).count();
 
-        if (keys_is_exist({ "cpu_temp_t1" , "cpu_temp_t2" , "cpu_temp_t3" , "cpu_temp_t4" , "cpu_temp_t5" , "cpu_temp_t6" ,
-            "cpu_fan_speed_t1", "cpu_fan_speed_t2", "cpu_fan_speed_t3", "cpu_fan_speed_t4", "cpu_fan_speed_t5", "cpu_fan_speed_t6", "cpu_fan_speed_t7"}))
-        {
-            std::cout << "cpu_tmp_thr: " << "00C    ";
-            std::cout << _ecw->getParam("cpu_temp_t1") << "C    ";
-            std::cout << _ecw->getParam("cpu_temp_t2") << "C    ";
-            std::cout << _ecw->getParam("cpu_temp_t3") << "C    ";
-            std::cout << _ecw->getParam("cpu_temp_t4") << "C    ";
-            std::cout << _ecw->getParam("cpu_temp_t5") << "C    ";
-            std::cout << _ecw->getParam("cpu_temp_t6") << "C    ";
-            std::cout << std::endl;
+        std::cout << "ec lock: 2 instances, " << count / 4 << " reads, " << elapsed / (count / 4) << "us/read";
+        for (const EcLock& lock : locks)
+            std::cout << ", " << lock.stats.acquisitions << " acquisitions (" << lock.stats.contended << " contended, max wait "
+                << lock.stats.wait.maxNs << "ns)";
+        std::cout << std::endl;
+#ifndef _WIN32
+        std::error_code error;
+        std::filesystem::remove(name, error);
+#endif
+    }
 
-            std::cout << "cpu_fan_thr: " << "    ";
-            std::cout << _ecw->getParam("cpu_fan_speed_t1") << "%    ";
-            std::cout << _ecw->getParam("cpu_fan_speed_t2") << "%    ";
-            std::cout << _ecw->getParam("cpu_fan_speed_t3") << "%    ";
-            std::cout << _ecw->getParam("cpu_fan_speed_t4") << "%    ";
-            std::cout << _ecw->getParam("cpu_fan_speed_t5") << "%    ";
-            std::cout << _ecw->getParam("cpu_fan_speed_t6") << "%    ";
-            std::cout << _ecw->getParam("cpu_fan_speed_t7") << "%    ";
-            std::cout << std::endl;
+    // Realtime reads against back to back dumps, a read waits for one bulk chunk at most
+    {
+        EcWorker worker(ec);
+        std::atomic<bool> dumping{ true };
+        std::thread dumper([&]()
+        {
+            while (dumping)
+                worker.read(EC_REGISTERS().set(), EC_BULK).get();
+        });
+        for (int i = 0; i < 200; i++)
+        {
+            worker.read(EC_REGISTERS().set(0x68), EC_REALTIME, std::chrono::steady_clock::now() + std::chrono::milliseconds(5)).get();
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
         }
+        dumping = false;
+        dumper.join();
 
-        if (keys_is_exist({ "gpu_temp_t1" , "gpu_temp_t2" , "gpu_temp_t3" , "gpu_temp_t4" , "gpu_temp_t5" , "gpu_temp_t6" ,
-            "gpu_fan_speed_t1", "gpu_fan_speed_t2", "gpu_fan_speed_t3", "gpu_fan_speed_t4", "gpu_fan_speed_t5", "gpu_fan_speed_t6", "gpu_fan_speed_t7" }))
-        {
-            std::cout << "gpu_tmp_thr: " << "00C    ";
-            std::cout << _ecw->getParam("gpu_temp_t1") << "C    ";
-            std::cout << _ecw->getParam("gpu_temp_t2") << "C    ";
-            std::cout << _ecw->getParam("gpu_temp_t3") << "C    ";
-            std::cout << _ecw->getParam("gpu_temp_t4") << "C    ";
-            std::cout << _ecw->getParam("gpu_temp_t5") << "C    ";
-            std::cout << _ecw->getParam("gpu_temp_t6") << "C    ";
-            std::cout << std::endl;
+        const EcWorkerStats& stats = worker.stats();
+        std::cout << "ec thread under dumps: " << stats.chunks << " bulk chunks, " << stats.preemptions << " preemptions, " << stats.unlocked << " unlocked safety batches" << std::endl;
+        PrintClassStats(stats);
+    }
 
-            std::cout << "gpu_fan_thr: " << "    ";
-            std::cout << _ecw->getParam("gpu_fan_speed_t1") << "%    ";
-            std::cout << _ecw->getParam("gpu_fan_speed_t2") << "%    ";
-            std::cout << _ecw->getParam("gpu_fan_speed_t3") << "%    ";
-            std::cout << _ecw->getParam("gpu_fan_speed_t4") << "%    ";
-            std::cout << _ecw->getParam("gpu_fan_speed_t5") << "%    ";
-            std::cout << _ecw->getParam("gpu_fan_speed_t6") << "%    ";
-            std::cout << _ecw->getParam("gpu_fan_speed_t7") << "%    ";
-            std::cout << std::endl;
-        }
+    ec.printStats();
+}
 
-        auto& cp = config->categorical_params;
-        for (auto& [k, _] : config->addresses)
-        {
-            if (used_params.find(k) != used_params.end())
-                continue;
+// Prints the sample last published with -pub, without loading the driver or the config
+void ShowPublished()
+{
+    SnapshotReader reader;
+    SharedSample sample;
+    if (!reader.open())
+    {
+        std::cout << "Nothing published, start fan_speed_editor -pub first\n";
+        return;
+    }
 
-            int v = _ecw->getParam(k);
-            std::cout << k << ": ";
-            std::cout << ((cp.find(k) != cp.end() && cp[k].find(v) != cp[k].end()) ? cp[k][v] : std::to_string(v));
-            std::cout << std::endl;
-        }
+    if (!reader.read(sample))
+    {
+        std::cout << "No complete sample published, the publisher is stale or not started yet\n";
+        return;
     }
 
-    void ShowChangeableParams()
+    for (UINT32 i = 0; i < sample.channelCount; i++)
     {
-        for (const auto& param : config->changeable_params)
-            std::cout << param << std::endl;
+        double value = sample.channels[i].value;
+        std::cout << sample.channels[i].name << ": ";
+        if (value == (double)(long long)value)
+            std::cout << (long long)value << std::endl;
+        else
+            std::cout << value << std::endl;
     }
 
-    void SetParam(std::string paramName, std::string paramValue)
+    UINT64 now = (UINT64)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+    std::cout << "age: " << (now > sample.timestampNs ? (now - sample.timestampNs) / 1000000 : 0) << " ms, sample " << sample.samples << std::endl;
+}
+
+// Summarizes telemetry files recorded with -r, per time bucket when bucketSeconds > 0,
+// and the time aboveParam spent over the threshold when it is set
+void Query(const std::vector<std::string>& files, double bucketSeconds, std::string aboveParam, double threshold)
+{
+    std::vector<std::unique_ptr<TelemetryReader>> readers;
+    for (const auto& file : files)
     {
-        std::cout << paramName << ": " << paramValue << " | ";
-        assert(config->changeable_params.find(paramName) != config->changeable_params.end() && "ERROR: parameter not found");
+        readers.push_back(std::make_unique<TelemetryReader>());
+        bool opened = readers.back()->open(file);
+        assert(opened && "ERROR: not a telemetry file");
+    }
+    std::sort(readers.begin(), readers.end(), [](const auto& a, const auto& b) { return a->info().startEpochNs < b->info().startEpochNs; });
 
-        int paramValueInt = -1;
-        try
+    // Channels of all files, matched by name
+    std::vector<std::string> names;
+    std::vector<std::vector<int>> columns(readers.size());
+    for (size_t r = 0; r < readers.size(); r++)
+        for (UINT32 c = 0; c < readers[r]->info().channelCount; c++)
         {
-            paramValueInt = std::stoi(paramValue);
+            std::string name = readers[r]->info().channels[c].name;
+            auto it = std::find(names.begin(), names.end(), name);
+            columns[r].push_back((int)(it - names.begin()));
+            if (it == names.end())
+                names.push_back(name);
         }
-        catch (...)
-        {
-            if (config->categorical_params.find(paramName) != config->categorical_params.end())
+
+    int aboveColumn = -1;
+    if (!aboveParam.empty())
+    {
+        aboveColumn = (int)(std::find(names.begin(), names.end(), aboveParam) - names.begin());
+        assert(aboveColumn < (int)names.size() && "ERROR: parameter not found");
+    }
+
+    std::vector<TelemetrySummary> summaries(names.size());
+
+    // Sensors mostly repeat their value, a run of one raw value is scaled and summarized once.
+    // Runs are indexed by the channel of the file being scanned.
+    int runRaw[TELEMETRY_MAX_CHANNELS];
+    double runValue[TELEMETRY_MAX_CHANNELS];
+    UINT64 runLength[TELEMETRY_MAX_CHANNELS] = {};
+    const std::vector<int>* runColumns = nullptr;
+    auto endRuns = [&]()
+    {
+        for (size_t c = 0; runColumns && c < runColumns->size(); c++)
+            if (runLength[c])
             {
-                for (auto& [addr, name] : config->categorical_params[paramName])
-                    if (paramValue == name)
-                    {
-                        paramValueInt = addr;
-                        break;
-                    }
+                summaries[(*runColumns)[c]].add(runValue[c], runLength[c]);
+                runLength[c] = 0;
             }
-        }
-        assert(paramValueInt != -1 && "ERROR: parameter label not found");
+    };
+    UINT64 bucketNs = (UINT64)(bucketSeconds * 1e9);
+    UINT64 bucketStart = 0, last = 0, samples = 0, spanNs = 0, aboveNs = 0;
+    bool open = false;
 
-        if (_ecw->getParam(paramName) == paramValueInt)
-            std::cout << "NOT CHANGED" << std::endl;
-        else
+    auto flush = [&]()
+    {
+        endRuns();
+        time_t seconds = (time_t)(bucketStart / 1000000000);
+        char when[32];
+        strftime(when, sizeof(when), "%Y-%m-%d %H:%M:%S", localtime(&seconds));
+        std::cout << when << " +" << (double)(last - bucketStart) / 1e9 << "s, " << samples << " samples" << std::endl;
+        for (size_t i = 0; i < names.size(); i++)
         {
-            _ecw->setParam(paramName, paramValueInt);
-            std::cout << "LOADED" << std::endl;
+            const TelemetrySummary& summary = summaries[i];
+            if (summary.count() == 0)
+                continue;
+            std::cout << "    " << names[i] << ": min " << summary.min() << ", max " << summary.max() << ", mean " << summary.mean()
+                << ", p50 " << summary.quantile(0.5) << ", p95 " << summary.quantile(0.95) << ", p99 " << summary.quantile(0.99) << std::endl;
         }
-    }
+        if (aboveColumn >= 0)
+            std::cout << "    " << aboveParam << " > " << threshold << ": " << aboveNs / 1e9 << "s ("
+                << (spanNs ? 100.0 * aboveNs / spanNs : 0.0) << "%)" << std::endl;
 
-    void Save(std::string profileName = "profile.ini")
+        for (auto& summary : summaries)
+            summary.reset();
+        samples = 0;
+        spanNs = 0;
+        aboveNs = 0;
+    };
+
+    for (size_t r = 0; r < readers.size(); r++)
     {
-        std::ofstream os(profileName);
-        for (const auto& param : config->saveable_params)
+        const TelemetryHeader& info = readers[r]->info();
+        runColumns = &columns[r];
+        int aboveChannel = -1;
+        for (UINT32 c = 0; c < info.channelCount; c++)
+            if (columns[r][c] == aboveColumn)
+                aboveChannel = (int)c;
+        bool first = true, wasAbove = false;
+        readers[r]->scan([&](UINT64 timestampNs, const int* values)
         {
-            os << param << '\n';
-            auto paramValue = _ecw->getParam(param);
-            if (config->categorical_params.find(param) != config->categorical_params.end() &&
-                config->categorical_params[param].find(paramValue) != config->categorical_params[param].end())
+            UINT64 time = info.startEpochNs + timestampNs;
+            if (!open || (bucketNs && time >= bucketStart + bucketNs))
             {
-                os << config->categorical_params[param][paramValue] << '\n';
+                if (open)
+                    flush();
+                bucketStart = bucketNs ? time - time % bucketNs : time;
+                open = true;
             }
-            else
+
+            // The interval up to this sample counts as above when the previous sample was
+            if (!first)
             {
-                os << paramValue << '\n';
+                spanNs += time - last;
+                if (wasAbove)
+                    aboveNs += time - last;
+            }
+            first = false;
+            wasAbove = false;
+            samples++;
+            for (UINT32 c = 0; c < info.channelCount; c++)
+            {
+                if (runLength[c] && values[c] == runRaw[c])
+                    runLength[c]++;
+                else
+                {
+                    if (runLength[c])
+                        summaries[(*runColumns)[c]].add(runValue[c], runLength[c]);
+                    runRaw[c] = values[c];
+                    runValue[c] = info.channels[c].scale(values[c]);
+                    runLength[c] = 1;
+                }
+            }
+            if (aboveChannel >= 0)
+                wasAbove = runValue[aboveChannel] > threshold;
+            last = time;
+        });
+        endRuns(); // The next file may scale the same raw value differently
+    }
+
+    if (open)
+        flush();
+    else
+        std::cout << "No samples" << std::endl;
+}
+
+std::vector<std::string> SplitRequest(const std::string& message)
+{
+    std::vector<std::string> tokens;
+    std::string::size_type begin = 0, end;
+    while ((end = message.find('\0', begin)) != std::string::npos)
+    {
+        tokens.push_back(message.substr(begin, end - begin));
+        begin = end + 1;
+    }
+    return tokens;
+}
+
+std::string JoinRequest(const std::vector<std::string>& tokens)
+{
+    std::string message;
+    for (const auto& token : tokens)
+        message.append(token).push_back('\0');
+    return message;
+}
+
+// Runs a command forwarded by a client, output goes to std::cout.
+// Returns false when the daemon should stop.
+bool Serve(FanSpeedEditor& fse, std::vector<std::string> request, std::string& data)
+{
+    bool showStats = !request.empty() && request.back() == "-stats";
+    if (showStats)
+        request.pop_back();
+
+    if (request.empty())
+        return true;
+
+    const std::string& command = request[0];
+    if (command == "-stop")
+    {
+        std::cout << "Daemon stopped\n";
+        return false;
+    }
+    else if (command == "-p")
+        fse.Show();
+    else if (command == "-s")
+    {
+        std::stringstream profile;
+        fse.Save(profile);
+        data = profile.str();
+    }
+    else if (command == "-l" && request.size() == 2)
+    {
+        // Validate up front, a bad profile must not take the daemon down
+        std::stringstream profile(request[1]);
+        std::string paramName, paramValue;
+        while (profile >> paramName >> paramValue)
+            if (!fse.IsValidParam(paramName, paramValue))
+            {
+                std::cout << "ERROR: bad profile entry " << paramName << " " << paramValue << "\n";
+                return true;
             }
+
+        profile.clear();
+        profile.seekg(0);
+        fse.Load(profile);
+        fse.Show();
+    }
+    else if (command == "-c" && request.size() == 3)
+    {
+        if (!fse.IsValidParam(request[1], request[2]))
+        {
+            std::cout << "ERROR: parameter or label not found\n";
+            return true;
         }
-        os.close();
-        std::cout << "Save success\n";
+
+        fse.SetParam(request[1], request[2]);
+        fse.Show();
     }
 
-    void Load(std::string profileName = "profile.ini")
+    if (showStats)
+        fse.ShowStats();
+
+    return true;
+}
+
+void RunDaemon(UINT32 freshnessMs)
+{
+    FanSpeedEditor fse;
+    EmbeddedControllerWrapper::instance()->setFreshness(freshnessMs);
+    IpcChannel channel;
+    bool listening = channel.listen();
+    assert(listening && "ERROR: daemon address is not available, or another daemon is running");
+    std::cerr << "Daemon listening on " << IPC_ADDRESS << std::endl;
+
+    bool running = true;
+    std::string request;
+    while (running)
+    {
+        if (!channel.accept())
+            continue;
+
+        if (channel.receive(request))
+        {
+            std::string data;
+            std::stringstream output;
+            auto stdout_buf = std::cout.rdbuf(output.rdbuf());
+            running = Serve(fse, SplitRequest(request), data);
+            std::cout.rdbuf(stdout_buf);
+
+            if (channel.send(output.str()))
+                channel.send(data);
+        }
+        channel.disconnect();
+    }
+}
+
+// Sends the command to a running daemon.
+// Returns false when the command can't be forwarded or no daemon is running.
+bool Forward(int argc, char** argv, bool showStats)
+{
+    std::vector<std::string> request(argv + 1, argv + argc);
+    std::string command = request[0];
+    std::string profileName = argc == 3 ? argv[2] : "profile.ini";
+
+    bool forwardable = command == "-p" || command == "-stop" ||
+        (command == "-s" && argc <= 3) ||
+        (command == "-l" && argc <= 3) ||
+        (command == "-c" && argc == 4);
+    if (!forwardable)
+        return false;
+
+    IpcChannel channel;
+    if (!channel.connect())
+        return false;
+
+    // Profiles are read and written by the client, paths are relative to its working directory
+    if (command == "-s")
+        request = { command };
+    else if (command == "-l")
     {
         std::ifstream profileFile(profileName, std::ios::in);
         assert(profileFile.is_open() && "Adress file does not exist");
+        std::stringstream profile;
+        profile << profileFile.rdbuf();
+        request = { command, profile.str() };
+    }
+    if (showStats)
+        request.push_back("-stats");
 
-        std::string paramName, paramValue;
-        while (profileFile >> paramName >> paramValue)
-            SetParam(paramName, paramValue);
-        std::cout << "Load success\n";
+    std::string output, data;
+    bool received = channel.send(JoinRequest(request)) && channel.receive(output) && channel.receive(data);
+    assert(received && "ERROR: daemon connection lost");
+    std::cout << output;
+
+    if (command == "-s")
+    {
+        std::ofstream os(profileName);
+        os << data;
+        os.close();
+        std::cout << "Save success\n";
     }
-};
+
+    return true;
+}
 
 void PrintUsage()
 {
@@ -316,6 +2282,22 @@ void PrintUsage()
     std::cout << "-l [file_name] - load profile\n";
     std::cout << "-pc - print changeable params\n";
     std::cout << "-c <param_name> <param_value> - change param\n";
+    std::cout << "-d [file_name] - print EC dump or save it to file\n";
+    std::cout << "-w <interval_ms> [max_interval_ms] - watch realtime params, sampled every interval, up to max while temperatures are flat\n";
+    std::cout << "-fc <target_temp> [period_ms] - control the fans in software to hold a temperature, Ctrl+C restores the curves\n";
+    std::cout << "-r <file_name> <interval_ms> [size_mb] [max_interval_ms] - record realtime params to a ring file, 16 MiB by default\n";
+    std::cout << "-pub <interval_ms> [max_interval_ms] - publish realtime params to shared memory for other processes\n";
+    std::cout << "-sub - print the params last published with -pub\n";
+    std::cout << "-q <file_name>... [-b <bucket_s>] [-t <param_name> <threshold>] - summarize recorded files, per time bucket\n";
+    std::cout << "-daemon [fresh_ms] - keep the EC open and serve -p, -s, -l, -c from other invocations, with sensors up to fresh_ms old\n";
+    std::cout << "-stop - stop the running daemon\n";
+    std::cout << "<command> -stats - print EC transaction statistics after the command\n";
+    std::cout << "<command> -v - print startup timing breakdown after the command\n";
+#ifndef _WIN32
+    std::cout << "<command> -ec <file_name> - use a 256-byte EC RAM file, e.g. a saved dump, instead of " << EC_SYS_PATH << "\n";
+#endif
+    std::cout << "-bench [count] - benchmark EC transactions against a simulated EC\n";
+    std::cout << "-gen [file_name] - generate a register map header for -DFIXED_REGISTER_MAP builds\n";
 }
 
 // MSI Center - User Scenario:
@@ -327,6 +2309,75 @@ void PrintUsage()
 
 int main(int argc, char** argv)
 {
+    if (argc > 1 && !strcmp(argv[1], "-bench"))
+    {
+        Benchmark(argc == 3 ? std::stoi(argv[2]) : 10000);
+        return 0;
+    }
+
+    if (argc > 1 && !strcmp(argv[1], "-gen"))
+    {
+        GenerateRegisterMap(argc == 3 ? argv[2] : "");
+        return 0;
+    }
+
+    if (argc == 2 && !strcmp(argv[1], "-sub"))
+    {
+        ShowPublished();
+        return 0;
+    }
+
+    if (argc > 2 && !strcmp(argv[1], "-q"))
+    {
+        std::vector<std::string> files;
+        double bucketSeconds = 0, threshold = 0;
+        std::string aboveParam;
+        for (int i = 2; i < argc; i++)
+            if (!strcmp(argv[i], "-b") && i + 1 < argc)
+                bucketSeconds = std::stod(argv[++i]);
+            else if (!strcmp(argv[i], "-t") && i + 2 < argc)
+            {
+                aboveParam = argv[++i];
+                threshold = std::stod(argv[++i]);
+            }
+            else
+                files.push_back(argv[i]);
+        Query(files, bucketSeconds, aboveParam, threshold);
+        return 0;
+    }
+
+    BOOL showStats = FALSE;
+    BOOL verbose = FALSE;
+    std::string ramPath;
+    for (; argc > 2; argc--)
+        if (!strcmp(argv[argc - 1], "-stats"))
+            showStats = TRUE;
+        else if (!strcmp(argv[argc - 1], "-v"))
+            verbose = TRUE;
+#ifndef _WIN32
+        else if (argc > 3 && !strcmp(argv[argc - 2], "-ec"))
+            ramPath = argv[--argc];
+#endif
+        else
+            break;
+
+    if (!ramPath.empty())
+        EmbeddedControllerWrapper::useRamFile(ramPath);
+
+    if (argc > 1 && !strcmp(argv[1], "-daemon"))
+    {
+        RunDaemon(argc == 3 ? std::stoi(argv[2]) : 0);
+        return 0;
+    }
+
+    // The daemon has the real EC open, a RAM file is only served by this process
+    if (argc > 1 && ramPath.empty() && Forward(argc, argv, showStats))
+    {
+        if (verbose)
+            timings.print();
+        return 0;
+    }
+
     FanSpeedEditor fse;
 
     if (argc > 1)
@@ -352,6 +2403,18 @@ int main(int argc, char** argv)
             fse.SetParam(argv[2], argv[3]);
             fse.Show();
         }
+        else if (!strcmp(argv[1], "-d") && argc == 3)
+            fse.Dump(argv[2]);
+        else if (!strcmp(argv[1], "-d"))
+            fse.Dump();
+        else if (!strcmp(argv[1], "-r") && argc >= 4 && argc <= 6)
+            fse.Record(argv[2], std::stod(argv[3]), argc >= 5 ? std::stoi(argv[4]) : 16, argc == 6 ? std::stod(argv[5]) : 0);
+        else if (!strcmp(argv[1], "-pub") && (argc == 3 || argc == 4))
+            fse.Publish(std::stod(argv[2]), std::stod(argv[argc - 1]));
+        else if (!strcmp(argv[1], "-fc") && (argc == 3 || argc == 4))
+            fse.Control(std::stod(argv[2]), argc == 4 ? std::stoi(argv[3]) : 1000);
+        else if (!strcmp(argv[1], "-w") && (argc == 3 || argc == 4))
+            fse.Watch(std::stoi(argv[2]), std::stoi(argv[argc - 1]));
         else if (!strcmp(argv[1], "-pc"))
             fse.ShowChangeableParams();
         else
@@ -362,5 +2425,11 @@ int main(int argc, char** argv)
         PrintUsage();
     }
 
+    if (showStats)
+        fse.ShowStats();
+
+    if (verbose)
+        timings.print();
+
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,252 @@
+#include "ipc.hpp"
+
+#ifndef _WIN32
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <cstring>
+#endif
+
+IpcChannel::IpcChannel(std::string address)
+{
+    this->address = address;
+}
+
+IpcChannel::~IpcChannel()
+{
+    this->close();
+}
+
+BOOL IpcChannel::send(const std::string& message)
+{
+    BYTE header[4];
+    for (UINT16 i = 0; i < 4; i++)
+        header[i] = (BYTE)(message.size() >> (8 * i));
+
+    return this->write((const char*)header, sizeof(header)) &&
+        this->write(message.data(), (UINT32)message.size());
+}
+
+BOOL IpcChannel::receive(std::string& message)
+{
+    BYTE header[4];
+    if (!this->read((char*)header, sizeof(header)))
+        return FALSE;
+
+    UINT32 size = header[0] | (header[1] << 8) | (header[2] << 16) | ((UINT32)header[3] << 24);
+    message.resize(size);
+    return size == 0 || this->read(&message[0], size);
+}
+
+#ifdef _WIN32
+
+BOOL IpcChannel::listen()
+{
+    this->pipe = CreateNamedPipeA(
+        this->address.c_str(),
+        PIPE_ACCESS_DUPLEX | FILE_FLAG_FIRST_PIPE_INSTANCE, // Fails while another daemon owns the name
+        PIPE_TYPE_BYTE | PIPE_READMODE_BYTE | PIPE_WAIT | PIPE_REJECT_REMOTE_CLIENTS,
+        1,
+        0x10000,
+        0x10000,
+        0,
+        NULL);
+
+    this->listening = this->pipe != INVALID_HANDLE_VALUE;
+    return this->listening;
+}
+
+BOOL IpcChannel::accept()
+{
+    return ConnectNamedPipe(this->pipe, NULL) || GetLastError() == ERROR_PIPE_CONNECTED;
+}
+
+BOOL IpcChannel::connect()
+{
+    // The daemon serves one client at a time, a busy pipe frees up once it is done with the current one
+    for (UINT16 attempt = 0; attempt < IPC_CONNECT_ATTEMPTS; attempt++)
+    {
+        this->pipe = CreateFileA(
+            this->address.c_str(),
+            GENERIC_READ | GENERIC_WRITE,
+            0,
+            NULL,
+            OPEN_EXISTING,
+            0,
+            NULL);
+
+        if (this->pipe != INVALID_HANDLE_VALUE)
+            return TRUE;
+        if (GetLastError() != ERROR_PIPE_BUSY || !WaitNamedPipeA(this->address.c_str(), IPC_BUSY_TIMEOUT_MS))
+            return FALSE;
+    }
+
+    return FALSE;
+}
+
+VOID IpcChannel::disconnect()
+{
+    if (this->pipe == INVALID_HANDLE_VALUE)
+        return;
+
+    if (this->listening)
+    {
+        FlushFileBuffers(this->pipe);
+        DisconnectNamedPipe(this->pipe);
+    }
+    else
+    {
+        CloseHandle(this->pipe);
+        this->pipe = INVALID_HANDLE_VALUE;
+    }
+}
+
+VOID IpcChannel::close()
+{
+    if (this->pipe != INVALID_HANDLE_VALUE)
+    {
+        CloseHandle(this->pipe);
+        this->pipe = INVALID_HANDLE_VALUE;
+    }
+    this->listening = FALSE;
+}
+
+BOOL IpcChannel::write(const char* buffer, UINT32 size)
+{
+    while (size > 0)
+    {
+        DWORD written = 0;
+        if (!WriteFile(this->pipe, buffer, size, &written, NULL))
+            return FALSE;
+        buffer += written;
+        size -= written;
+    }
+
+    return TRUE;
+}
+
+BOOL IpcChannel::read(char* buffer, UINT32 size)
+{
+    while (size > 0)
+    {
+        DWORD received = 0;
+        if (!ReadFile(this->pipe, buffer, size, &received, NULL) || received == 0)
+            return FALSE;
+        buffer += received;
+        size -= received;
+    }
+
+    return TRUE;
+}
+
+#else
+
+BOOL IpcChannel::listen()
+{
+    sockaddr_un socketAddress = {};
+    socketAddress.sun_family = AF_UNIX;
+    if (this->address.size() >= sizeof(socketAddress.sun_path))
+        return FALSE;
+    strcpy(socketAddress.sun_path, this->address.c_str());
+
+    // A socket file that still accepts connections belongs to a running daemon, only a stale one is replaced
+    IpcChannel probe(this->address);
+    if (probe.connect())
+        return FALSE;
+
+    this->listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (this->listenFd < 0)
+        return FALSE;
+
+    // Only the owner (the daemon runs as root to reach the EC) may send commands
+    unlink(this->address.c_str());
+    mode_t mask = umask(0077);
+    BOOL bound = bind(this->listenFd, (sockaddr*)&socketAddress, sizeof(socketAddress)) == 0;
+    umask(mask);
+
+    this->listening = bound && ::listen(this->listenFd, 8) == 0;
+    if (!this->listening)
+        this->close();
+
+    return this->listening;
+}
+
+BOOL IpcChannel::accept()
+{
+    this->connectionFd = ::accept(this->listenFd, NULL, NULL);
+    return this->connectionFd >= 0;
+}
+
+BOOL IpcChannel::connect()
+{
+    sockaddr_un socketAddress = {};
+    socketAddress.sun_family = AF_UNIX;
+    if (this->address.size() >= sizeof(socketAddress.sun_path))
+        return FALSE;
+    strcpy(socketAddress.sun_path, this->address.c_str());
+
+    this->connectionFd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (this->connectionFd < 0)
+        return FALSE;
+
+    if (::connect(this->connectionFd, (sockaddr*)&socketAddress, sizeof(socketAddress)) != 0)
+    {
+        this->disconnect();
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+VOID IpcChannel::disconnect()
+{
+    if (this->connectionFd >= 0)
+    {
+        ::close(this->connectionFd);
+        this->connectionFd = -1;
+    }
+}
+
+VOID IpcChannel::close()
+{
+    this->disconnect();
+    if (this->listenFd >= 0)
+    {
+        ::close(this->listenFd);
+        this->listenFd = -1;
+        if (this->listening)
+            unlink(this->address.c_str());
+    }
+    this->listening = FALSE;
+}
+
+BOOL IpcChannel::write(const char* buffer, UINT32 size)
+{
+    while (size > 0)
+    {
+        ssize_t written = ::send(this->connectionFd, buffer, size, MSG_NOSIGNAL);
+        if (written <= 0)
+            return FALSE;
+        buffer += written;
+        size -= written;
+    }
+
+    return TRUE;
+}
+
+BOOL IpcChannel::read(char* buffer, UINT32 size)
+{
+    while (size > 0)
+    {
+        ssize_t received = ::recv(this->connectionFd, buffer, size, 0);
+        if (received <= 0)
+            return FALSE;
+        buffer += received;
+        size -= received;
+    }
+
+    return TRUE;
+}
+
+#endif
@@ -0,0 +1,97 @@
+#ifndef IPC_H
+#define IPC_H
+
+#include <string>
+
+#include "3rdparty/EmbeddedController/platform.hpp"
+
+#ifdef _WIN32
+auto constexpr IPC_ADDRESS = "\\\\.\\pipe\\fan_speed_editor";
+constexpr UINT16 IPC_CONNECT_ATTEMPTS = 5;  // Connects tried while the pipe is busy with other clients
+constexpr DWORD IPC_BUSY_TIMEOUT_MS = 2000; // Wait for the pipe to free up before each further attempt
+#else
+auto constexpr IPC_ADDRESS = "/run/fan_speed_editor.sock";
+#endif
+
+/**
+ * Local channel between the resident daemon and CLI clients.
+ * Uses a named pipe on Windows and a Unix domain socket elsewhere.
+ * Messages are framed with a 4-byte little-endian length prefix.
+*/
+class IpcChannel
+{
+public:
+    /** @param address Pipe name or socket path. */
+    IpcChannel(std::string address = IPC_ADDRESS);
+    ~IpcChannel();
+
+    IpcChannel(const IpcChannel&) = delete;
+    IpcChannel& operator=(const IpcChannel&) = delete;
+
+    /**
+     * Start serving on the address, replacing a stale socket left by a previous daemon.
+     * @return Successfulness of operation, FALSE while another daemon serves the address.
+     */
+    BOOL listen();
+
+    /**
+     * Block until the next client connects.
+     * @return Successfulness of operation.
+     */
+    BOOL accept();
+
+    /**
+     * Connect to a running daemon, waiting a while for it if it is busy with another client.
+     * @return Whether a daemon is listening on the address.
+     */
+    BOOL connect();
+
+    /**
+     * Send a single message over the current connection.
+     * @param message Message payload.
+     * @return Successfulness of operation.
+     */
+    BOOL send(const std::string& message);
+
+    /**
+     * Receive a single message from the current connection.
+     * @param message Destination of message payload.
+     * @return Successfulness of operation.
+     */
+    BOOL receive(std::string& message);
+
+    /** Close the current connection, a listening channel keeps listening */
+    VOID disconnect();
+
+    /** Close the channel */
+    VOID close();
+
+protected:
+    std::string address;
+    BOOL listening = FALSE;
+
+#ifdef _WIN32
+    HANDLE pipe = INVALID_HANDLE_VALUE;
+#else
+    int listenFd = -1;
+    int connectionFd = -1;
+#endif
+
+    /**
+     * Write raw bytes to the current connection.
+     * @param buffer Source of bytes.
+     * @param size Number of bytes.
+     * @return Successfulness of operation.
+     */
+    BOOL write(const char* buffer, UINT32 size);
+
+    /**
+     * Read raw bytes from the current connection.
+     * @param buffer Destination of bytes.
+     * @param size Number of bytes.
+     * @return Successfulness of operation.
+     */
+    BOOL read(char* buffer, UINT32 size);
+};
+
+#endif
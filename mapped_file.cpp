@@ -0,0 +1,153 @@
+#include "mapped_file.hpp"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::~MappedFile()
+{
+    this->close();
+}
+
+#ifdef _WIN32
+
+BOOL MappedFile::open(std::string path)
+{
+    this->close();
+    this->file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (this->file == INVALID_HANDLE_VALUE)
+        return FALSE;
+
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(this->file, &fileSize) || fileSize.QuadPart == 0)
+    {
+        this->close();
+        return FALSE;
+    }
+
+    this->length = fileSize.QuadPart;
+    return this->map(FALSE);
+}
+
+BOOL MappedFile::create(std::string path, UINT64 size)
+{
+    this->close();
+    this->file = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (this->file == INVALID_HANDLE_VALUE)
+        return FALSE;
+
+    this->length = size;
+    return this->map(TRUE);
+}
+
+BOOL MappedFile::map(BOOL writable)
+{
+    // A read-write mapping larger than the file grows it
+    this->mapping = CreateFileMappingA(
+        this->file,
+        NULL,
+        writable ? PAGE_READWRITE : PAGE_READONLY,
+        (DWORD)(this->length >> 32),
+        (DWORD)(this->length & 0xFFFFFFFF),
+        NULL);
+    if (this->mapping != NULL)
+        this->view = (BYTE*)MapViewOfFile(this->mapping, writable ? FILE_MAP_WRITE : FILE_MAP_READ, 0, 0, (SIZE_T)this->length);
+
+    if (this->view == nullptr)
+    {
+        this->close();
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+VOID MappedFile::close()
+{
+    if (this->view != nullptr)
+        UnmapViewOfFile(this->view);
+    if (this->mapping != NULL)
+        CloseHandle(this->mapping);
+    if (this->file != INVALID_HANDLE_VALUE)
+        CloseHandle(this->file);
+
+    this->view = nullptr;
+    this->mapping = NULL;
+    this->file = INVALID_HANDLE_VALUE;
+    this->length = 0;
+}
+
+#else
+
+BOOL MappedFile::open(std::string path)
+{
+    this->close();
+    this->fd = ::open(path.c_str(), O_RDONLY);
+    if (this->fd < 0)
+        return FALSE;
+
+    struct stat info;
+    if (fstat(this->fd, &info) != 0 || info.st_size == 0)
+    {
+        this->close();
+        return FALSE;
+    }
+
+    this->length = info.st_size;
+    return this->map(FALSE);
+}
+
+BOOL MappedFile::create(std::string path, UINT64 size)
+{
+    this->close();
+    this->fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+    if (this->fd < 0)
+        return FALSE;
+
+    struct stat info;
+    if (fstat(this->fd, &info) != 0 || ((UINT64)info.st_size < size && ftruncate(this->fd, size) != 0))
+    {
+        this->close();
+        return FALSE;
+    }
+
+    this->length = size;
+    return this->map(TRUE);
+}
+
+BOOL MappedFile::map(BOOL writable)
+{
+    void* address = mmap(
+        nullptr,
+        this->length,
+        writable ? PROT_READ | PROT_WRITE : PROT_READ,
+        MAP_SHARED,
+        this->fd,
+        0);
+
+    if (address == MAP_FAILED)
+    {
+        this->close();
+        return FALSE;
+    }
+
+    this->view = (BYTE*)address;
+    return TRUE;
+}
+
+VOID MappedFile::close()
+{
+    if (this->view != nullptr)
+        munmap(this->view, this->length);
+    if (this->fd >= 0)
+        ::close(this->fd);
+
+    this->view = nullptr;
+    this->fd = -1;
+    this->length = 0;
+}
+
+#endif
@@ -0,0 +1,58 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <string>
+
+#include "3rdparty/EmbeddedController/platform.hpp"
+
+/** File mapped into memory, read-only or read-write */
+class MappedFile
+{
+public:
+    MappedFile() = default;
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    /**
+     * Map an existing file read-only.
+     * @param path Path of file.
+     * @return Successfulness of operation.
+     */
+    BOOL open(std::string path);
+
+    /**
+     * Map a file read-write, creating it or growing it to the given size first.
+     * @param path Path of file.
+     * @param size Size of mapping in bytes.
+     * @return Successfulness of operation.
+     */
+    BOOL create(std::string path, UINT64 size);
+
+    /** Unmap and close the file */
+    VOID close();
+
+    BYTE* data() { return this->view; }
+    UINT64 size() { return this->length; }
+
+protected:
+    BYTE* view = nullptr;
+    UINT64 length = 0;
+
+#ifdef _WIN32
+    HANDLE file = INVALID_HANDLE_VALUE;
+    HANDLE mapping = NULL;
+#else
+    int fd = -1;
+#endif
+
+    /**
+     * Map the opened file.
+     * @param writable Whether the mapping is read-write.
+     * @return Successfulness of operation.
+     */
+    BOOL map(BOOL writable);
+};
+
+#endif
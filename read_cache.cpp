@@ -0,0 +1,114 @@
+#include "read_cache.hpp"
+
+ReadCache::ReadCache(EcWorker& worker, UINT32 freshnessMs) : worker(worker)
+{
+    this->setFreshness(freshnessMs);
+}
+
+EC_DUMP ReadCache::read(const EC_REGISTERS& registers, EC_DEADLINE deadline)
+{
+    std::shared_future<EC_DUMP> result;
+    UINT64 id = 0;
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        // A read that completed while its leader is not scheduled yet is as good as the cache
+        for (size_t i = 0; i < this->flights.size(); )
+            if (this->flights[i].result.wait_for(std::chrono::seconds(0)) == std::future_status::ready)
+                this->land(i);
+            else
+                i++;
+
+        if (this->freshness.count() > 0 && (this->cache.valid & registers) == registers)
+        {
+            auto now = std::chrono::steady_clock::now();
+            auto oldest = now;
+            for (UINT16 address = 0x00; address <= 0xFF; address++)
+                if (registers[address] && this->stamps[address] < oldest)
+                    oldest = this->stamps[address];
+
+            if (now - oldest <= this->freshness)
+            {
+                this->counters.hits++;
+                EC_DUMP snapshot = this->cache;
+                snapshot.valid = registers;
+                snapshot.timestamp = oldest;
+                return snapshot;
+            }
+        }
+
+        // A read with a tighter deadline may be dropped unread, only one that would wait at least as long is joined
+        for (const Flight& flight : this->flights)
+            if ((flight.registers & registers) == registers && flight.deadline >= deadline)
+            {
+                this->counters.joined++;
+                result = flight.result;
+                break;
+            }
+
+        if (!result.valid())
+        {
+            this->counters.misses++;
+            id = ++this->lastId;
+            result = this->worker.read(registers, EC_REALTIME, deadline).share();
+            this->flights.push_back({ id, this->generation, registers, deadline, result });
+        }
+    }
+
+    EC_DUMP snapshot = result.get();
+    if (id)
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        for (size_t i = 0; i < this->flights.size(); i++)
+            if (this->flights[i].id == id)
+            {
+                this->land(i);
+                break;
+            }
+    }
+
+    snapshot.valid &= registers;
+    return snapshot;
+}
+
+VOID ReadCache::land(size_t index)
+{
+    const Flight& flight = this->flights[index];
+    if (flight.generation == this->generation)
+    {
+        const EC_DUMP& snapshot = flight.result.get();
+        for (UINT16 address = 0x00; address <= 0xFF; address++)
+            if (snapshot.valid[address])
+            {
+                this->cache.values[address] = snapshot.values[address];
+                this->stamps[address] = snapshot.timestamp;
+            }
+        this->cache.valid |= snapshot.valid;
+    }
+    this->flights.erase(this->flights.begin() + index);
+}
+
+VOID ReadCache::invalidate(const EC_REGISTERS& registers)
+{
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->cache.valid &= ~registers;
+    this->generation++;
+
+    // Later reads must not wait for a value read before the change
+    for (size_t i = 0; i < this->flights.size(); )
+        if ((this->flights[i].registers & registers).any())
+            this->flights.erase(this->flights.begin() + i);
+        else
+            i++;
+}
+
+VOID ReadCache::setFreshness(UINT32 freshnessMs)
+{
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->freshness = std::chrono::milliseconds(freshnessMs);
+}
+
+ReadCacheStats ReadCache::stats()
+{
+    std::lock_guard<std::mutex> lock(this->mutex);
+    return this->counters;
+}
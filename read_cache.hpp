@@ -0,0 +1,85 @@
+#ifndef READ_CACHE_H
+#define READ_CACHE_H
+
+#include <chrono>
+#include <future>
+#include <mutex>
+#include <vector>
+
+#include "ec_worker.hpp"
+
+/** Statistics of a ReadCache */
+struct ReadCacheStats
+{
+    UINT64 hits = 0;   // Reads served from registers younger than the freshness window
+    UINT64 misses = 0; // Reads that went to the EC
+    UINT64 joined = 0; // Reads that waited for an identical or wider read already in flight
+};
+
+/**
+ * Realtime reads in front of an EcWorker.
+ * A read whose registers are all covered by a read in flight, with a deadline at least as late,
+ * waits for that one instead of queueing its own (single-flight), and within the freshness
+ * window registers are served from the last values read. The mutex only guards the
+ * bookkeeping, never an EC transaction.
+*/
+class ReadCache
+{
+public:
+    /**
+     * @param worker EC thread to read through.
+     * @param freshnessMs Age up to which cached registers are served, 0 to only share reads in flight.
+     */
+    ReadCache(EcWorker& worker, UINT32 freshnessMs = 0);
+
+    ReadCache(const ReadCache&) = delete;
+    ReadCache& operator=(const ReadCache&) = delete;
+
+    /**
+     * Read registers at realtime priority.
+     * @param registers Set of register addresses to read.
+     * @param deadline Latest start of a read that goes to the EC.
+     * @return Snapshot where only the requested registers are valid, stamped with the age of the oldest.
+     */
+    EC_DUMP read(const EC_REGISTERS& registers, EC_DEADLINE deadline = EC_NO_DEADLINE);
+
+    /**
+     * Forget registers, e.g. before and after writing them. Reads in flight are not cached either.
+     * @param registers Set of register addresses.
+     */
+    VOID invalidate(const EC_REGISTERS& registers);
+
+    /** @param freshnessMs Age up to which cached registers are served, 0 to disable. */
+    VOID setFreshness(UINT32 freshnessMs);
+
+    ReadCacheStats stats();
+
+protected:
+    /** Read queued on the EC thread that later identical reads wait for */
+    struct Flight
+    {
+        UINT64 id;
+        UINT64 generation; // Invalidations before it started, its result is only kept if none came after
+        EC_REGISTERS registers;
+        EC_DEADLINE deadline;
+        std::shared_future<EC_DUMP> result;
+    };
+
+    EcWorker& worker;
+    std::chrono::steady_clock::duration freshness;
+    std::mutex mutex;
+    EC_DUMP cache;
+    std::array<std::chrono::steady_clock::time_point, 0x100> stamps = {};
+    std::vector<Flight> flights;
+    UINT64 lastId = 0;
+    UINT64 generation = 0;
+    ReadCacheStats counters;
+
+    /**
+     * Keep the result of a completed read unless registers were invalidated since it started, and forget the read.
+     * @param index Index of the read in flights, called with the mutex held.
+     */
+    VOID land(size_t index);
+};
+
+#endif
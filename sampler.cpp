@@ -0,0 +1,57 @@
+#include "sampler.hpp"
+
+#include <cmath>
+
+// Weight of the newest slope in the EWMA
+auto constexpr SLOPE_ALPHA = 0.3;
+// Growth of the interval per stable sample
+auto constexpr INTERVAL_DECAY = 1.25;
+
+AdaptiveSampler::AdaptiveSampler(double minIntervalMs, double maxIntervalMs, double slopeThreshold)
+    : minIntervalMs(minIntervalMs),
+      maxIntervalMs(maxIntervalMs < minIntervalMs ? minIntervalMs : maxIntervalMs),
+      slopeThreshold(slopeThreshold),
+      current(minIntervalMs)
+{
+}
+
+double AdaptiveSampler::update(const std::vector<double>& temperatures, double nowMs)
+{
+    if (this->samples == 0)
+    {
+        this->firstMs = nowMs;
+        this->last = temperatures;
+        this->slopes.assign(temperatures.size(), 0);
+    }
+    else if (nowMs > this->lastMs)
+    {
+        double dt = (nowMs - this->lastMs) / 1000;
+        this->steepest = 0;
+        for (size_t i = 0; i < temperatures.size() && i < this->last.size(); i++)
+        {
+            this->slopes[i] += SLOPE_ALPHA * ((temperatures[i] - this->last[i]) / dt - this->slopes[i]);
+            this->last[i] = temperatures[i];
+            if (std::fabs(this->slopes[i]) > this->steepest)
+                this->steepest = std::fabs(this->slopes[i]);
+        }
+
+        if (this->steepest > this->slopeThreshold)
+            this->current = this->minIntervalMs;
+        else
+        {
+            this->current *= INTERVAL_DECAY;
+            if (this->current > this->maxIntervalMs)
+                this->current = this->maxIntervalMs;
+        }
+    }
+
+    this->samples++;
+    this->lastMs = nowMs;
+    return this->current;
+}
+
+double AdaptiveSampler::skipped()
+{
+    double fixed = (this->lastMs - this->firstMs) / this->minIntervalMs + 1;
+    return this->samples && fixed > this->samples ? fixed - this->samples : 0;
+}
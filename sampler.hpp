@@ -0,0 +1,53 @@
+#ifndef SAMPLER_H
+#define SAMPLER_H
+
+#include <vector>
+
+#include "3rdparty/EmbeddedController/platform.hpp"
+
+/**
+ * Sampling interval that follows how fast temperatures move.
+ * The slope of each temperature is smoothed with an EWMA; while any slope is
+ * steeper than the threshold the interval drops to the minimum, and while all
+ * are flat it grows by a quarter per sample up to the maximum.
+*/
+class AdaptiveSampler
+{
+public:
+    /**
+     * @param minIntervalMs Interval while temperatures move, the fixed rate this replaces.
+     * @param maxIntervalMs Interval once temperatures are stable, equal to minIntervalMs for a fixed rate.
+     * @param slopeThreshold Slope in C/s above which sampling speeds up.
+     */
+    AdaptiveSampler(double minIntervalMs, double maxIntervalMs, double slopeThreshold = 0.5);
+
+    /**
+     * Feed a sample.
+     * @param temperatures Current temperatures, the same ones in the same order every time.
+     * @param nowMs Monotonic time of the sample in milliseconds.
+     * @return Interval until the next sample in milliseconds.
+     */
+    double update(const std::vector<double>& temperatures, double nowMs);
+
+    double interval() { return this->current; }
+
+    /** @return Steepest smoothed slope of the last update in C/s. */
+    double slope() { return this->steepest; }
+
+    /** @return Samples a fixed rate at the minimum interval would have taken but this one skipped. */
+    double skipped();
+
+protected:
+    double minIntervalMs;
+    double maxIntervalMs;
+    double slopeThreshold;
+    double current;
+    double steepest = 0;
+    double firstMs = 0;
+    double lastMs = 0;
+    UINT64 samples = 0;
+    std::vector<double> last;
+    std::vector<double> slopes;
+};
+
+#endif
@@ -0,0 +1,128 @@
+#include "shared_snapshot.hpp"
+
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <thread>
+
+auto constexpr SHARED_SNAPSHOT_MAGIC = 0x31304853424C4553ULL; // "SELBSH01"
+
+std::string SharedSnapshotPath()
+{
+#ifdef _WIN32
+    return (std::filesystem::temp_directory_path() / SHARED_SNAPSHOT_NAME).string();
+#else
+    return SHARED_SNAPSHOT_NAME;
+#endif
+}
+
+const SharedChannel* SharedSample::find(const std::string& name) const
+{
+    for (UINT32 i = 0; i < this->channelCount; i++)
+        if (name == this->channels[i].name)
+            return &this->channels[i];
+    return nullptr;
+}
+
+BOOL SnapshotPublisher::create(const std::vector<std::string>& names, std::string path)
+{
+    this->close();
+    if (names.empty() || names.size() > TELEMETRY_MAX_CHANNELS)
+        return FALSE;
+    if (!this->file.create(path.empty() ? SharedSnapshotPath() : path, sizeof(SharedSnapshot)))
+        return FALSE;
+
+    this->snapshot = (SharedSnapshot*)this->file.data();
+    UINT32 sequence = this->snapshot->magic == SHARED_SNAPSHOT_MAGIC ? this->snapshot->sequence.load() : 0;
+
+    // Written as a sample, so readers of a previous publisher's segment don't see it half renamed
+    this->snapshot->sequence.store(sequence | 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    this->snapshot->magic = SHARED_SNAPSHOT_MAGIC;
+    this->snapshot->channelCount = (UINT32)names.size();
+    this->snapshot->timestampNs = 0;
+    this->snapshot->samples = 0;
+    for (size_t i = 0; i < names.size(); i++)
+    {
+        SharedChannel& channel = this->snapshot->channels[i];
+        memset(&channel, 0, sizeof(channel));
+        strncpy(channel.name, names[i].c_str(), sizeof(channel.name) - 1);
+    }
+    this->snapshot->sequence.store((sequence | 1) + 1, std::memory_order_release);
+    return TRUE;
+}
+
+VOID SnapshotPublisher::publish(const int* raw, const double* values)
+{
+    if (this->snapshot == nullptr)
+        return;
+
+    UINT32 sequence = this->snapshot->sequence.load(std::memory_order_relaxed);
+    this->snapshot->sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    this->snapshot->timestampNs = (UINT64)std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+    this->snapshot->samples++;
+    for (UINT32 i = 0; i < this->snapshot->channelCount; i++)
+    {
+        this->snapshot->channels[i].raw = raw[i];
+        this->snapshot->channels[i].value = values[i];
+    }
+
+    this->snapshot->sequence.store(sequence + 2, std::memory_order_release);
+}
+
+VOID SnapshotPublisher::close()
+{
+    this->file.close();
+    this->snapshot = nullptr;
+}
+
+BOOL SnapshotReader::open(std::string path)
+{
+    this->snapshot = nullptr;
+    if (!this->file.open(path.empty() ? SharedSnapshotPath() : path) || this->file.size() < sizeof(SharedSnapshot))
+        return FALSE;
+
+    this->snapshot = (const SharedSnapshot*)this->file.data();
+    return TRUE;
+}
+
+BOOL SnapshotReader::read(SharedSample& sample)
+{
+    if (this->snapshot == nullptr)
+        return FALSE;
+
+    // A publisher that died midway through a sample leaves the sequence odd for good
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(SHARED_SNAPSHOT_READ_TIMEOUT_MS);
+    for (int attempt = 0;; attempt++)
+    {
+        UINT32 before = this->snapshot->sequence.load(std::memory_order_acquire);
+        if (before & 1)
+        {
+            // A sample takes well under a microsecond to write, yield in case the publisher was preempted
+            if (attempt > 100)
+            {
+                if (std::chrono::steady_clock::now() >= deadline)
+                    return FALSE;
+                std::this_thread::yield();
+            }
+            continue;
+        }
+
+        if (this->snapshot->magic != SHARED_SNAPSHOT_MAGIC)
+            return FALSE;
+        UINT32 count = this->snapshot->channelCount;
+        sample.channelCount = count > TELEMETRY_MAX_CHANNELS ? TELEMETRY_MAX_CHANNELS : count;
+        sample.timestampNs = this->snapshot->timestampNs;
+        sample.samples = this->snapshot->samples;
+        memcpy(sample.channels, this->snapshot->channels, sample.channelCount * sizeof(SharedChannel));
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (this->snapshot->sequence.load(std::memory_order_relaxed) == before)
+            return sample.samples > 0;
+        if (attempt > 100 && std::chrono::steady_clock::now() >= deadline)
+            return FALSE;
+    }
+}
@@ -0,0 +1,110 @@
+#ifndef SHARED_SNAPSHOT_H
+#define SHARED_SNAPSHOT_H
+
+#include <atomic>
+#include <string>
+
+#include "mapped_file.hpp"
+#include "telemetry.hpp"
+
+#ifdef _WIN32
+auto constexpr SHARED_SNAPSHOT_NAME = "fan_speed_editor.shm"; // In the temp directory
+#else
+auto constexpr SHARED_SNAPSHOT_NAME = "/dev/shm/fan_speed_editor";
+#endif
+
+constexpr UINT32 SHARED_SNAPSHOT_READ_TIMEOUT_MS = 100; // Longest a reader retries before it treats the segment as stale
+
+/** Latest value of a published param */
+struct SharedChannel
+{
+    char name[40];
+    int raw;
+    UINT32 reserved;
+    double value; // In the param's unit
+};
+
+/**
+ * Fixed layout of the shared segment.
+ * The sequence is odd while the publisher writes; a reader copies the rest and
+ * retries when the sequence was odd or changed meanwhile, so neither side ever waits on a lock.
+*/
+struct SharedSnapshot
+{
+    UINT64 magic;
+    std::atomic<UINT32> sequence;
+    UINT32 channelCount;
+    UINT64 timestampNs; // Wall clock time of the sample
+    UINT64 samples;     // Samples published so far
+    SharedChannel channels[TELEMETRY_MAX_CHANNELS];
+};
+
+static_assert(std::atomic<UINT32>::is_always_lock_free, "the sequence must be lock-free to be shared between processes");
+
+/** Reader's copy of a published sample */
+struct SharedSample
+{
+    UINT32 channelCount = 0;
+    UINT64 timestampNs = 0;
+    UINT64 samples = 0;
+    SharedChannel channels[TELEMETRY_MAX_CHANNELS] = {};
+
+    /** @return Channel of the param, or nullptr when it isn't published. */
+    const SharedChannel* find(const std::string& name) const;
+};
+
+/** Writes samples into the shared segment, one publisher at a time */
+class SnapshotPublisher
+{
+public:
+    /**
+     * Create the shared segment.
+     * @param names Published params, at most TELEMETRY_MAX_CHANNELS.
+     * @param path Path of segment, defaults to SHARED_SNAPSHOT_NAME.
+     * @return Successfulness of operation.
+     */
+    BOOL create(const std::vector<std::string>& names, std::string path = "");
+
+    /**
+     * Publish a sample.
+     * @param raw Raw value of each param.
+     * @param values Value of each param in its unit.
+     */
+    VOID publish(const int* raw, const double* values);
+
+    /** Close the segment, readers keep the last sample */
+    VOID close();
+
+protected:
+    MappedFile file;
+    SharedSnapshot* snapshot = nullptr;
+};
+
+/** Reads the shared segment without touching the EC */
+class SnapshotReader
+{
+public:
+    /**
+     * Map the shared segment read-only.
+     * @param path Path of segment, defaults to SHARED_SNAPSHOT_NAME.
+     * @return Whether a publisher has created the segment.
+     */
+    BOOL open(std::string path = "");
+
+    /**
+     * Copy the latest sample, retrying while the publisher is midway through one.
+     * Gives up after SHARED_SNAPSHOT_READ_TIMEOUT_MS, e.g. when the publisher died while writing a sample.
+     * @param sample Destination of sample.
+     * @return Whether a complete sample was copied.
+     */
+    BOOL read(SharedSample& sample);
+
+protected:
+    MappedFile file;
+    const SharedSnapshot* snapshot = nullptr;
+};
+
+/** @return Default path of the shared segment. */
+std::string SharedSnapshotPath();
+
+#endif
@@ -0,0 +1,199 @@
+#include "telemetry.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+
+auto constexpr TELEMETRY_MAGIC = 0x31304D454C455446ULL; // "FTELEM01"
+
+BOOL TelemetryWriter::create(std::string path, const std::vector<TelemetryChannel>& channels, UINT64 size, UINT32 blockSize)
+{
+    this->close();
+    if (channels.empty() || channels.size() > TELEMETRY_MAX_CHANNELS || blockSize < sizeof(TelemetryHeader) ||
+        size / blockSize < 3 || size / blockSize > 0xFFFFFFFF)
+        return FALSE;
+
+    // The header takes the first block, so the ring blocks stay aligned
+    size -= size % blockSize;
+    if (!this->file.create(path, size))
+        return FALSE;
+
+    this->header = (TelemetryHeader*)this->file.data();
+    *this->header = TelemetryHeader();
+    this->header->blockSize = blockSize;
+    this->header->blockCount = (UINT32)(size / blockSize - 1);
+    this->header->channelCount = (UINT32)channels.size();
+    this->header->startEpochNs = (UINT64)std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+    for (size_t i = 0; i < channels.size(); i++)
+        this->header->channels[i] = channels[i];
+
+    // A reused file may hold blocks of an older recording
+    for (UINT32 i = 0; i < this->header->blockCount; i++)
+        memset(this->file.data() + (UINT64)(i + 1) * blockSize, 0, sizeof(TelemetryBlock));
+
+    this->header->magic = TELEMETRY_MAGIC;
+    this->sequence = 0;
+    this->sampleCount = 0;
+    this->byteCount = 0;
+    this->nextBlock();
+    return TRUE;
+}
+
+VOID TelemetryWriter::nextBlock()
+{
+    UINT32 index = (UINT32)(this->sequence % this->header->blockCount);
+    this->block = (TelemetryBlock*)(this->file.data() + (UINT64)(index + 1) * this->header->blockSize);
+    this->block->sequence = 0;
+    this->block->used = 0;
+    this->block->samples = 0;
+    this->block->sequence = ++this->sequence;
+
+    this->lastTimestamp = 0;
+    memset(this->last, 0, sizeof(this->last));
+}
+
+VOID TelemetryWriter::append(UINT64 timestampNs, const int* values)
+{
+    if (this->header == nullptr)
+        return;
+
+    // Worst case is a 10-byte timestamp and 5 bytes per value
+    BYTE sample[10 + 5 * TELEMETRY_MAX_CHANNELS];
+    BYTE* cursor = sample;
+    auto varint = [&](UINT64 value)
+    {
+        while (value >= 0x80)
+        {
+            *cursor++ = (BYTE)(value | 0x80);
+            value >>= 7;
+        }
+        *cursor++ = (BYTE)value;
+    };
+
+    UINT32 capacity = this->header->blockSize - sizeof(TelemetryBlock);
+    for (int attempt = 0; attempt < 2; attempt++)
+    {
+        cursor = sample;
+        varint(timestampNs - this->lastTimestamp);
+        for (UINT32 i = 0; i < this->header->channelCount; i++)
+        {
+            UINT32 delta = (UINT32)values[i] - this->last[i];
+            varint((delta << 1) ^ (0u - (delta >> 31)));
+        }
+
+        UINT32 length = (UINT32)(cursor - sample);
+        if (this->block->used + length > capacity)
+        {
+            this->nextBlock(); // Encoded again against the fresh block
+            continue;
+        }
+
+        // Bytes first and counters last, so a reader never decodes a partial sample
+        memcpy((BYTE*)(this->block + 1) + this->block->used, sample, length);
+        this->block->used += length;
+        this->block->samples++;
+
+        this->lastTimestamp = timestampNs;
+        for (UINT32 i = 0; i < this->header->channelCount; i++)
+            this->last[i] = (UINT32)values[i];
+        this->sampleCount++;
+        this->byteCount += length;
+        return;
+    }
+}
+
+VOID TelemetryWriter::close()
+{
+    this->file.close();
+    this->header = nullptr;
+    this->block = nullptr;
+}
+
+BOOL TelemetryReader::open(std::string path)
+{
+    this->order.clear();
+    this->header = nullptr;
+    if (!this->file.open(path) || this->file.size() < sizeof(TelemetryHeader))
+        return FALSE;
+
+    const TelemetryHeader* candidate = (const TelemetryHeader*)this->file.data();
+    if (candidate->magic != TELEMETRY_MAGIC || candidate->blockSize < sizeof(TelemetryHeader) ||
+        candidate->channelCount == 0 || candidate->channelCount > TELEMETRY_MAX_CHANNELS ||
+        (UINT64)(candidate->blockCount + 1) * candidate->blockSize > this->file.size())
+        return FALSE;
+    this->header = candidate;
+
+    for (UINT32 i = 0; i < this->header->blockCount; i++)
+    {
+        const TelemetryBlock* block = (const TelemetryBlock*)(this->file.data() + (UINT64)(i + 1) * this->header->blockSize);
+        if (block->sequence != 0 && block->used <= this->header->blockSize - sizeof(TelemetryBlock))
+            this->order.push_back(block);
+    }
+    std::sort(this->order.begin(), this->order.end(),
+        [](const TelemetryBlock* a, const TelemetryBlock* b) { return a->sequence < b->sequence; });
+    return TRUE;
+}
+
+// Buckets are 2% wide, the midpoint of a bucket is within 1% of everything in it
+auto constexpr SUMMARY_GAMMA = 1.02;
+
+int TelemetrySummary::bucket(double magnitude)
+{
+    int index = (int)std::ceil(std::log(magnitude / MIN_MAGNITUDE) / std::log(SUMMARY_GAMMA));
+    return index < 0 ? 0 : index >= BUCKETS ? BUCKETS - 1 : index;
+}
+
+double TelemetrySummary::bucketValue(int bucket)
+{
+    return MIN_MAGNITUDE * std::pow(SUMMARY_GAMMA, bucket) * 2 / (1 + SUMMARY_GAMMA);
+}
+
+VOID TelemetrySummary::reset()
+{
+    this->samples = 0;
+    this->lowest = HUGE_VAL;
+    this->highest = -HUGE_VAL;
+    this->sum = 0;
+    this->zeros = 0;
+    memset(this->positive, 0, sizeof(this->positive));
+    memset(this->negative, 0, sizeof(this->negative));
+}
+
+VOID TelemetrySummary::add(double value, UINT64 count)
+{
+    if (value < this->lowest)
+        this->lowest = value;
+    if (value > this->highest)
+        this->highest = value;
+    this->samples += count;
+    this->sum += value * count;
+
+    double magnitude = std::fabs(value);
+    if (magnitude < MIN_MAGNITUDE)
+        this->zeros += count;
+    else
+        (value < 0 ? this->negative : this->positive)[bucket(magnitude)] += count;
+}
+
+double TelemetrySummary::quantile(double fraction) const
+{
+    if (this->samples == 0)
+        return 0;
+
+    // Walk from the most negative bucket up to the most positive one
+    UINT64 rank = (UINT64)(fraction * (this->samples - 1));
+    double value = this->highest;
+    UINT64 seen = 0;
+    for (int i = BUCKETS - 1; i >= 0 && seen <= rank; i--)
+        if ((seen += this->negative[i]) > rank)
+            value = -bucketValue(i);
+    if (seen <= rank && (seen += this->zeros) > rank)
+        value = 0;
+    for (int i = 0; i < BUCKETS && seen <= rank; i++)
+        if ((seen += this->positive[i]) > rank)
+            value = bucketValue(i);
+
+    return value < this->lowest ? this->lowest : value > this->highest ? this->highest : value;
+}
@@ -0,0 +1,224 @@
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <string>
+#include <vector>
+
+#include "mapped_file.hpp"
+
+auto constexpr TELEMETRY_MAX_CHANNELS = 16;
+
+/** Recorded param, with the conversion the reader applies to its raw values */
+struct TelemetryChannel
+{
+    char name[40] = {};
+    double factor = 1;
+    double offset = 0;
+    BYTE reciprocal = FALSE;
+    BYTE isSigned = FALSE;
+    BYTE reserved[6] = {};
+
+    /** @return Value of a raw sample in the channel's unit. */
+    double scale(int raw) const
+    {
+        double x = this->isSigned ? (double)raw : (double)(UINT32)raw;
+        if (this->reciprocal)
+            return x ? this->factor / x : 0;
+        return this->factor * x + this->offset;
+    }
+};
+
+/** Start of a telemetry file, followed by the blocks */
+struct TelemetryHeader
+{
+    UINT64 magic;
+    UINT32 blockSize;
+    UINT32 blockCount;
+    UINT32 channelCount;
+    UINT32 reserved;
+    UINT64 startEpochNs; // Wall clock time of sample timestamp 0
+    TelemetryChannel channels[TELEMETRY_MAX_CHANNELS];
+};
+
+/** Start of a block, a block is decodable on its own and is the unit the ring overwrites */
+struct TelemetryBlock
+{
+    UINT64 sequence; // Order of blocks in the ring, 0 for a never written block
+    UINT32 used;     // Bytes of samples after the block header
+    UINT32 samples;
+};
+
+/**
+ * Appends samples to a fixed-size memory-mapped ring file.
+ * Timestamps and values are stored as varint deltas to the previous sample of the block
+ * (zigzag for values), so a slowly changing sensor costs about a byte per channel.
+ * Deltas restart in every block and when the ring is full the oldest block is overwritten.
+*/
+class TelemetryWriter
+{
+public:
+    /**
+     * Create or reset a ring file.
+     * @param path Path of file.
+     * @param channels Recorded params, at most TELEMETRY_MAX_CHANNELS.
+     * @param size Size of file in bytes, this is all the disk the recording will ever use.
+     * @param blockSize Size of a block in bytes.
+     * @return Successfulness of operation.
+     */
+    BOOL create(std::string path, const std::vector<TelemetryChannel>& channels, UINT64 size, UINT32 blockSize = 4096);
+
+    /**
+     * Append a sample.
+     * @param timestampNs Time since the start of the recording.
+     * @param values Raw value of each channel.
+     */
+    VOID append(UINT64 timestampNs, const int* values);
+
+    /** Close the file, samples already appended stay in it */
+    VOID close();
+
+    UINT64 samples() { return this->sampleCount; }
+    UINT64 bytes() { return this->byteCount; }
+
+protected:
+    MappedFile file;
+    TelemetryHeader* header = nullptr;
+    TelemetryBlock* block = nullptr;
+    UINT64 sequence = 0;
+    UINT64 sampleCount = 0;
+    UINT64 byteCount = 0;
+    UINT64 lastTimestamp = 0;
+    UINT32 last[TELEMETRY_MAX_CHANNELS] = {};
+
+    /** Start the next block of the ring, overwriting the oldest one when it is full */
+    VOID nextBlock();
+};
+
+/** Reads a ring file written by TelemetryWriter, oldest sample first */
+class TelemetryReader
+{
+public:
+    /**
+     * Map a ring file.
+     * @param path Path of file.
+     * @return Whether the file is a valid telemetry file.
+     */
+    BOOL open(std::string path);
+
+    const TelemetryHeader& info() { return *this->header; }
+
+    /**
+     * Decode every sample in order, without allocating.
+     * @param callback Called as callback(timestampNs, values) with the raw value of each channel.
+     */
+    template <typename Callback>
+    VOID scan(Callback&& callback);
+
+protected:
+    MappedFile file;
+    const TelemetryHeader* header = nullptr;
+    std::vector<const TelemetryBlock*> order;
+};
+
+/**
+ * Streaming summary of one channel: count, min, max, mean and quantiles.
+ * Quantiles come from a fixed log-bucketed histogram, accurate to 1% of the value
+ * for magnitudes between 0.01 and 1e9, so adding a sample never allocates.
+*/
+class TelemetrySummary
+{
+public:
+    TelemetrySummary() { this->reset(); }
+
+    /**
+     * @param value Sample in the channel's unit.
+     * @param count Number of consecutive samples with this value.
+     */
+    VOID add(double value, UINT64 count = 1);
+
+    /** Forget all samples */
+    VOID reset();
+
+    /**
+     * @param fraction Quantile between 0 and 1, e.g. 0.99 for p99.
+     * @return Approximate value at the quantile, 0 when empty.
+     */
+    double quantile(double fraction) const;
+
+    UINT64 count() const { return this->samples; }
+    double min() const { return this->samples ? this->lowest : 0; }
+    double max() const { return this->samples ? this->highest : 0; }
+    double mean() const { return this->samples ? this->sum / this->samples : 0; }
+
+protected:
+    static constexpr double MIN_MAGNITUDE = 0.01;
+    static constexpr int BUCKETS = 1280; // log(1e9 / 0.01) / log(1.02)
+
+    UINT64 samples;
+    double lowest;
+    double highest;
+    double sum;
+    UINT64 zeros;
+    UINT64 positive[BUCKETS];
+    UINT64 negative[BUCKETS];
+
+
+    static int bucket(double magnitude);
+    static double bucketValue(int bucket);
+};
+
+/** @return Next varint of a block, or FALSE when the block ends inside it. */
+inline BOOL ReadVarint(const BYTE*& cursor, const BYTE* end, UINT64& value)
+{
+    if (cursor < end && !(*cursor & 0x80)) // Most deltas fit a byte
+    {
+        value = *cursor++;
+        return TRUE;
+    }
+
+    value = 0;
+    for (int shift = 0; cursor < end && shift < 64; shift += 7)
+    {
+        BYTE b = *cursor++;
+        value |= (UINT64)(b & 0x7F) << shift;
+        if (!(b & 0x80))
+            return TRUE;
+    }
+    return FALSE;
+}
+
+template <typename Callback>
+VOID TelemetryReader::scan(Callback&& callback)
+{
+    UINT32 channels = this->header->channelCount;
+    int values[TELEMETRY_MAX_CHANNELS] = {};
+
+    for (const TelemetryBlock* block : this->order)
+    {
+        // Deltas restart from zero in every block
+        const BYTE* cursor = (const BYTE*)(block + 1);
+        const BYTE* end = cursor + block->used;
+        UINT64 timestamp = 0;
+        UINT32 raw[TELEMETRY_MAX_CHANNELS] = {};
+        for (UINT32 sample = 0; sample < block->samples; sample++)
+        {
+            UINT64 value;
+            if (!ReadVarint(cursor, end, value))
+                break;
+            timestamp += value;
+
+            UINT32 channel = 0;
+            for (; channel < channels && ReadVarint(cursor, end, value); channel++)
+            {
+                raw[channel] += (UINT32)(value >> 1) ^ (0u - (UINT32)(value & 1));
+                values[channel] = (int)raw[channel];
+            }
+            if (channel < channels) // Torn sample at the end of a block being written
+                break;
+
+            callback(timestamp, (const int*)values);
+        }
+    }
+}
+
+#endif
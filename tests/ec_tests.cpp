@@ -0,0 +1,617 @@
+// Behaviour tests of EmbeddedController, EcWorker and ReadCache against SimulatedEc and, on Linux, EcSysIo on a RAM file,
+// and round trips of the telemetry file format.
+// Exits with 0 when all tests pass, a failing check aborts with its message.
+
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../3rdparty/EmbeddedController/ec.hpp"
+#include "../3rdparty/EmbeddedController/simulated.hpp"
+#include "../ec_worker.hpp"
+#include "../read_cache.hpp"
+#include "../telemetry.hpp"
+
+#undef NDEBUG
+
+#include <cassert>
+
+/** SimulatedEc that can hold IBF busy and ignore burst requests, to reach the failure paths */
+class FaultyEc : public SimulatedEc
+{
+public:
+    UINT32 busyPolls = 0;     // Status reads that report IBF set before the EC answers again
+    UINT16 burstRefusals = 0; // Burst requests to drop, so no acknowledge comes
+
+    using SimulatedEc::SimulatedEc;
+
+    BYTE readIoPortByte(BYTE port) override
+    {
+        if (port == this->scPort && this->busyPolls > 0)
+        {
+            this->busyPolls--;
+            this->portReads++;
+            return EC_IBF;
+        }
+        return SimulatedEc::readIoPortByte(port);
+    }
+
+    VOID writeIoPortByte(BYTE port, BYTE value) override
+    {
+        if (port == this->scPort && value == BE_EC && this->burstRefusals > 0)
+        {
+            this->burstRefusals--;
+            this->portWrites++;
+            return;
+        }
+        SimulatedEc::writeIoPortByte(port, value);
+    }
+};
+
+/** SimulatedEc that calls back after Data port accesses, to act at an exact point of a transaction */
+class HookedEc : public SimulatedEc
+{
+public:
+    std::function<VOID(BYTE value)> afterDataRead;  // Called with the byte the host read
+    std::function<VOID(BYTE value)> afterDataWrite; // Called with the byte the host wrote
+
+    using SimulatedEc::SimulatedEc;
+
+    BYTE readIoPortByte(BYTE port) override
+    {
+        BYTE value = SimulatedEc::readIoPortByte(port);
+        if (port == this->dataPort && this->afterDataRead)
+            this->afterDataRead(value);
+        return value;
+    }
+
+    VOID writeIoPortByte(BYTE port, BYTE value) override
+    {
+        SimulatedEc::writeIoPortByte(port, value);
+        if (port == this->dataPort && this->afterDataWrite)
+            this->afterDataWrite(value);
+    }
+};
+
+/** Holds the EC thread in a task until released, so the requests queued meanwhile are served together */
+class Gate
+{
+public:
+    Gate(EcWorker& worker)
+    {
+        std::shared_future<VOID> released = this->opened.get_future().share();
+        std::promise<VOID>* entered = &this->entered;
+        worker.execute([released, entered](EmbeddedController&) { entered->set_value(); released.wait(); });
+        this->entered.get_future().wait();
+    }
+
+    ~Gate()
+    {
+        if (!this->released)
+            this->release();
+    }
+
+    VOID release()
+    {
+        this->released = TRUE;
+        this->opened.set_value();
+    }
+
+private:
+    std::promise<VOID> opened;
+    std::promise<VOID> entered;
+    BOOL released = FALSE;
+};
+
+/** @return Statistics of the worker, read on its thread. */
+EcWorkerStats WorkerStats(EcWorker& worker)
+{
+    EcWorkerStats stats;
+    worker.execute([&](EmbeddedController&) { stats = worker.stats(); }, EC_REALTIME, FALSE).wait();
+    return stats;
+}
+
+/** Controller that gives up a wait after `timeout` polls, so failures cost no time */
+EmbeddedController FastFailing(std::shared_ptr<PortIo> io, UINT16 timeout = 4)
+{
+    EmbeddedController ec(io, EC_SC, EC_DATA, LITTLE_ENDIAN, 5, timeout);
+    ec.polling.deadlineUs = 0;
+    return ec;
+}
+
+void HandshakeReadsAndWrites()
+{
+    SimulatedLatency latency;
+    latency.ibfPolls = 2;
+    latency.obfPolls = 1;
+    auto sim = std::make_shared<SimulatedEc>(latency);
+    EmbeddedController ec(sim);
+    ec.useBurst = FALSE;
+    sim->poke(0x20, 0xAA);
+
+    assert(ec.readByte(0x20) == 0xAA && "ERROR: read through the handshake");
+    assert(ec.writeByte(0x21, 0x55) && "ERROR: write through the handshake");
+    // The EC takes the data byte on a later status poll, the next handshake waits for that
+    assert(ec.readByte(0x21) == 0x55 && sim->peek(0x21) == 0x55 && "ERROR: written value");
+    assert(ec.stats.transactions == 3 && ec.stats.reads.retries == 0 && ec.stats.writes.retries == 0 && "ERROR: handshake counts");
+}
+
+void MultiByteOrder()
+{
+    auto sim = std::make_shared<SimulatedEc>();
+    EmbeddedController little(sim);
+    EmbeddedController big(sim, EC_SC, EC_DATA, BIG_ENDIAN);
+
+    assert(little.writeDword(0x40, 0x11223344) && "ERROR: dword write");
+    assert(sim->peek(0x40) == 0x44 && sim->peek(0x43) == 0x11 && "ERROR: little endian layout");
+    assert(little.readDword(0x40) == 0x11223344 && "ERROR: little endian dword");
+    assert(big.readWord(0x40) == 0x4433 && "ERROR: big endian word");
+}
+
+void RetryAfterBusyEc()
+{
+    auto sim = std::make_shared<FaultyEc>();
+    EmbeddedController ec = FastFailing(sim);
+    ec.useBurst = FALSE;
+    sim->poke(0x30, 0x7E);
+    sim->busyPolls = 4; // Exactly one wait of the first attempt
+
+    assert(ec.readByte(0x30) == 0x7E && "ERROR: read after a retry");
+    assert(ec.stats.reads.retries == 1 && ec.stats.reads.failures == 0 && ec.stats.ibf.timeouts == 1 && "ERROR: retry counts");
+}
+
+void DeadEcIsBounded()
+{
+    auto sim = std::make_shared<FaultyEc>();
+    EmbeddedController ec(sim);
+    ec.useBurst = FALSE;
+    sim->busyPolls = 0xFFFFFFFF;
+
+    auto begin = std::chrono::steady_clock::now();
+    EC_DUMP dump = ec.dump(EC_REGISTERS().set(0x10).set(0x11));
+    auto elapsed = std::chrono::steady_clock::now() - begin;
+
+    assert(dump.valid.none() && ec.stats.reads.failures == 2 && "ERROR: reads of a dead EC must fail");
+    // Two operations of 2ms each, with a wide margin for a loaded machine
+    assert(elapsed < std::chrono::milliseconds(200) && "ERROR: a dead EC must not stall for retry times every wait");
+}
+
+void BurstMode()
+{
+    auto sim = std::make_shared<SimulatedEc>();
+    EmbeddedController ec(sim);
+    {
+        BurstSession burst(ec);
+        assert(ec.beginBurst() && "ERROR: nested burst must report the outer session");
+        ec.endBurst();
+        assert(ec.writeByte(0x50, 0x01) && ec.readByte(0x50) == 0x01 && "ERROR: transactions in burst mode");
+    }
+    assert(ec.useBurst && "ERROR: an acknowledged burst keeps burst mode on");
+
+    EC_DUMP dump = ec.dump();
+    assert(dump.valid.all() && dump[0x50] == 0x01 && "ERROR: dump in burst mode");
+}
+
+void BurstRefusals()
+{
+    auto sim = std::make_shared<FaultyEc>();
+    EmbeddedController ec = FastFailing(sim);
+
+    // A single missed acknowledge is forgiven and the next request is granted
+    sim->burstRefusals = 1;
+    assert(!ec.beginBurst() && "ERROR: refused burst reported active");
+    ec.endBurst();
+    assert(ec.useBurst && "ERROR: one refusal must not disable burst mode");
+    assert(ec.beginBurst() && "ERROR: burst after a refusal");
+    ec.endBurst();
+
+    // Only refusals in a row give up on it
+    sim->burstRefusals = ec.burstRefusals;
+    for (UINT16 i = 0; i < ec.burstRefusals; i++)
+    {
+        ec.beginBurst();
+        ec.endBurst();
+    }
+    assert(!ec.useBurst && "ERROR: repeated refusals must disable burst mode");
+    sim->poke(0x60, 0x42);
+    assert(ec.readByte(0x60) == 0x42 && "ERROR: transactions without burst mode");
+}
+
+void LateBurstAcknowledge()
+{
+    // The EC takes the burst request only after the wait for its acknowledge gave up
+    SimulatedLatency latency;
+    latency.ibfPolls = 8;
+    auto sim = std::make_shared<SimulatedEc>(latency);
+    EmbeddedController ec = FastFailing(sim);
+    sim->poke(0x70, 0x11);
+    sim->poke(0x71, 0x22);
+
+    assert(!ec.beginBurst() && "ERROR: burst reported active without an acknowledge");
+    ec.endBurst();
+    assert(ec.readByte(0x70) == 0x11 && "ERROR: a late acknowledge must not pass for register data");
+    assert(ec.readByte(0x71) == 0x22 && "ERROR: a late acknowledge must not shift later reads");
+    assert(ec.stats.staleBytes == 1 && "ERROR: late acknowledge not discarded");
+}
+
+void ConcurrentProducersDrainOnce()
+{
+    constexpr size_t PRODUCERS = 4;
+    constexpr size_t PER_PRODUCER = 5000;
+    constexpr size_t TOTAL = PRODUCERS * PER_PRODUCER;
+    EcQueue queue;
+    std::unique_ptr<EcRequest[]> requests(new EcRequest[TOTAL]);
+
+    std::vector<std::thread> producers;
+    for (size_t producer = 0; producer < PRODUCERS; producer++)
+        producers.emplace_back([&, producer]()
+        {
+            for (size_t i = 0; i < PER_PRODUCER; i++)
+                queue.push(&requests[producer * PER_PRODUCER + i]);
+        });
+
+    // Popped while the producers push, each request once and in the order of its producer
+    std::vector<UINT16> seen(TOTAL, 0);
+    std::array<size_t, PRODUCERS> next = {};
+    for (size_t popped = 0; popped < TOTAL; )
+    {
+        EcRequest* request = queue.pop();
+        if (!request)
+        {
+            std::this_thread::yield();
+            continue;
+        }
+        size_t index = request - requests.get();
+        assert(index < TOTAL && seen[index]++ == 0 && "ERROR: request popped twice");
+        assert(index % PER_PRODUCER == next[index / PER_PRODUCER]++ && "ERROR: order of a producer not kept");
+        popped++;
+    }
+
+    for (std::thread& producer : producers)
+        producer.join();
+    assert(queue.empty() && !queue.pop() && "ERROR: queue not drained");
+}
+
+void AdjacentReadsMerged()
+{
+    auto sim = std::make_shared<SimulatedEc>();
+    EmbeddedController ec(sim);
+    EcWorker worker(ec);
+    sim->poke(0x10, 0x01);
+    sim->poke(0x20, 0x02);
+
+    std::vector<std::future<EC_DUMP>> reads;
+    {
+        Gate gate(worker);
+        reads.push_back(worker.read(EC_REGISTERS().set(0x10)));
+        reads.push_back(worker.read(EC_REGISTERS().set(0x10).set(0x20)));
+        reads.push_back(worker.read(EC_REGISTERS().set(0x20)));
+    }
+
+    EC_DUMP first = reads[0].get();
+    EC_DUMP second = reads[1].get();
+    EC_DUMP third = reads[2].get();
+    assert(first.valid == EC_REGISTERS().set(0x10) && first[0x10] == 0x01 && "ERROR: first read");
+    assert(second.valid.count() == 2 && second[0x10] == 0x01 && second[0x20] == 0x02 && "ERROR: second read");
+    assert(third.valid == EC_REGISTERS().set(0x20) && third[0x20] == 0x02 && "ERROR: third read");
+
+    EcWorkerStats stats = WorkerStats(worker);
+    assert(stats.readPasses == 1 && stats.coalesced == 2 && "ERROR: adjacent reads must share one pass");
+    assert(ec.stats.transactions == 2 && "ERROR: a merged pass reads each register once");
+}
+
+void SafetyPreemptsBulk()
+{
+    auto sim = std::make_shared<HookedEc>();
+    EmbeddedController ec(sim);
+    EcWorker worker(ec);
+
+    // Queued from the EC thread while the second chunk is being read
+    std::future<BOOL> write;
+    sim->afterDataWrite = [&](BYTE value)
+    {
+        if (value == EcWorker::BULK_CHUNK && !write.valid())
+        {
+            std::array<BYTE, 0x100> values = {};
+            values[0xF0] = 0x5A;
+            write = worker.write(EC_REGISTERS().set(0xF0), values, EC_SAFETY);
+        }
+    };
+
+    EC_DUMP dump = worker.read(EC_REGISTERS().set(), EC_BULK).get();
+    assert(write.valid() && write.get() && "ERROR: safety write");
+    assert(dump.valid.all() && dump[0xF0] == 0x5A && "ERROR: the write must land between chunks, before the chunk of 0xF0");
+
+    EcWorkerStats stats = WorkerStats(worker);
+    assert(stats.chunks == 0x100 / EcWorker::BULK_CHUNK && stats.preemptions == 1 && "ERROR: bulk read not preempted");
+}
+
+void ExpiredDeadlineRefused()
+{
+    auto sim = std::make_shared<SimulatedEc>();
+    EmbeddedController ec(sim);
+    EcWorker worker(ec);
+    std::array<BYTE, 0x100> values = {};
+    values[0x40] = 0x77;
+
+    std::future<EC_DUMP> read;
+    std::future<BOOL> write;
+    {
+        Gate gate(worker);
+        EC_DEADLINE deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(1);
+        read = worker.read(EC_REGISTERS().set(0x40), EC_REALTIME, deadline);
+        write = worker.write(EC_REGISTERS().set(0x40), values, EC_SAFETY, deadline);
+        std::this_thread::sleep_until(deadline + std::chrono::milliseconds(5));
+    }
+
+    assert(read.get().valid.none() && "ERROR: an expired read must return no registers");
+    assert(!write.get() && sim->peek(0x40) == 0x00 && "ERROR: an expired write must fail without writing");
+    EcWorkerStats stats = WorkerStats(worker);
+    assert(stats.classes[EC_REALTIME].expired == 1 && stats.classes[EC_SAFETY].expired == 1 && "ERROR: expiry counts");
+    assert(ec.stats.transactions == 0 && "ERROR: expired requests must leave the EC alone");
+}
+
+void IdenticalReadsJoinFlight()
+{
+    constexpr size_t READERS = 4;
+    auto sim = std::make_shared<SimulatedEc>();
+    EmbeddedController ec(sim);
+    EcWorker worker(ec);
+    ReadCache cache(worker);
+    sim->poke(0x50, 0x12);
+    sim->poke(0x51, 0x34);
+    EC_REGISTERS registers = EC_REGISTERS().set(0x50).set(0x51);
+
+    std::vector<EC_DUMP> results(READERS);
+    std::vector<std::thread> readers;
+    {
+        Gate gate(worker);
+        for (size_t i = 0; i < READERS; i++)
+            readers.emplace_back([&, i]() { results[i] = cache.read(registers); });
+        // All of them in flight or waiting for it before the EC thread moves on
+        for (ReadCacheStats stats = cache.stats(); stats.misses + stats.joined < READERS; stats = cache.stats())
+            std::this_thread::yield();
+    }
+    for (std::thread& reader : readers)
+        reader.join();
+
+    for (const EC_DUMP& result : results)
+        assert(result.valid == registers && result[0x50] == 0x12 && result[0x51] == 0x34 && "ERROR: joined read");
+    ReadCacheStats stats = cache.stats();
+    assert(stats.misses == 1 && stats.joined == READERS - 1 && "ERROR: identical reads must join one flight");
+    assert(ec.stats.transactions == 2 && "ERROR: one read of the registers for all readers");
+}
+
+void InvalidatePreventsStaleFill()
+{
+    auto sim = std::make_shared<HookedEc>();
+    EmbeddedController ec(sim);
+    ec.useBurst = FALSE; // The only Data port read is then the reply
+    EcWorker worker(ec);
+    ReadCache cache(worker, 60000);
+    sim->poke(0x60, 0x01);
+
+    // The register changes and is invalidated after the EC answered, before the reader keeps the value
+    BOOL changed = FALSE;
+    sim->afterDataRead = [&](BYTE)
+    {
+        if (!changed)
+        {
+            changed = TRUE;
+            sim->poke(0x60, 0x02);
+            cache.invalidate(EC_REGISTERS().set(0x60));
+        }
+    };
+
+    assert(cache.read(EC_REGISTERS().set(0x60))[0x60] == 0x01 && "ERROR: value at the time of the read");
+    assert(cache.read(EC_REGISTERS().set(0x60))[0x60] == 0x02 && "ERROR: a read invalidated in flight must not fill the cache");
+    ReadCacheStats stats = cache.stats();
+    assert(stats.hits == 0 && stats.misses == 2 && "ERROR: cache counts");
+    assert(cache.read(EC_REGISTERS().set(0x60))[0x60] == 0x02 && cache.stats().hits == 1 && "ERROR: a clean read fills the cache");
+}
+
+/** Sample as appended to a telemetry file */
+struct RecordedSample
+{
+    UINT64 timestamp;
+    std::array<int, 3> values;
+
+    bool operator==(const RecordedSample& other) const { return this->timestamp == other.timestamp && this->values == other.values; }
+};
+
+/**
+ * Append samples to a small ring file and decode it back.
+ * @param count Number of samples to append.
+ * @param appended Destination of the samples appended.
+ * @return Samples decoded, oldest first.
+ */
+std::vector<RecordedSample> TelemetryRoundTrip(size_t count, std::vector<RecordedSample>& appended)
+{
+    std::string path = (std::filesystem::temp_directory_path() / "ec_tests.telemetry").string();
+    std::vector<TelemetryChannel> channels(3);
+    TelemetryWriter writer;
+    // The header takes the first block, 3 blocks of ring behind it
+    assert(writer.create(path, channels, 4 * 2048, 2048) && "ERROR: ring file not created");
+
+    // Up and down deltas of every size, including the full range of the signed and unsigned raw values
+    UINT64 timestamp = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        timestamp += 1000000 + (i % 7) * 12345;
+        int wave = (int)(i % 40) - 20;
+        int jump = i % 50 == 0 ? INT_MIN : i % 50 == 1 ? INT_MAX : (int)(i * 2654435761u);
+        RecordedSample sample = { timestamp, { wave, -wave * 1000, jump } };
+        writer.append(sample.timestamp, sample.values.data());
+        appended.push_back(sample);
+    }
+    writer.close();
+
+    std::vector<RecordedSample> decoded;
+    TelemetryReader reader;
+    assert(reader.open(path) && reader.info().channelCount == 3 && "ERROR: ring file not readable");
+    reader.scan([&](UINT64 timestampNs, const int* values)
+    {
+        decoded.push_back({ timestampNs, { values[0], values[1], values[2] } });
+    });
+
+    std::error_code error;
+    std::filesystem::remove(path, error);
+    return decoded;
+}
+
+void TelemetryDeltasRoundTrip()
+{
+    std::vector<RecordedSample> appended;
+    std::vector<RecordedSample> decoded = TelemetryRoundTrip(200, appended);
+    assert(decoded == appended && "ERROR: samples must decode to the values appended");
+}
+
+void TelemetryRingWrap()
+{
+    std::vector<RecordedSample> appended;
+    std::vector<RecordedSample> decoded = TelemetryRoundTrip(5000, appended);
+
+    // The oldest blocks were overwritten, what is left is the newest samples without a gap
+    assert(!decoded.empty() && decoded.size() < appended.size() && "ERROR: the ring must have wrapped");
+    assert(std::equal(decoded.begin(), decoded.end(), appended.end() - decoded.size()) && "ERROR: samples after the wrap");
+}
+
+void SummaryQuantiles()
+{
+    // Skewed sensor-like data across signs and magnitudes, deterministic
+    std::vector<double> values;
+    UINT32 state = 12345;
+    for (int i = 0; i < 100000; i++)
+    {
+        state = state * 1664525u + 1013904223u;
+        double uniform = (state >> 8) / (double)(1 << 24);
+        values.push_back(i % 10 == 0 ? -uniform * 50 : std::exp(uniform * 12) / 10);
+    }
+
+    TelemetrySummary summary;
+    for (double value : values)
+        summary.add(value);
+    std::sort(values.begin(), values.end());
+
+    for (double fraction : { 0.01, 0.05, 0.5, 0.95, 0.99 })
+    {
+        double exact = values[(size_t)(fraction * (values.size() - 1))];
+        double estimate = summary.quantile(fraction);
+        // The stated error: 1% of the value, magnitudes under 0.01 count as 0
+        assert(std::fabs(estimate - exact) <= 0.01 * std::fabs(exact) + 0.01 && "ERROR: quantile outside the sketch's error");
+    }
+    assert(summary.count() == values.size() && summary.min() == values.front() && summary.max() == values.back() && "ERROR: summary bounds");
+    assert(summary.quantile(0) == values.front() && summary.quantile(1) == values.back() && "ERROR: extreme quantiles");
+}
+
+#ifndef _WIN32
+
+/** 256-byte EC RAM file in the temp directory, removed with the object */
+struct RamFile
+{
+    std::string path = (std::filesystem::temp_directory_path() / "ec_tests_ram.bin").string();
+
+    RamFile(size_t size = 0x100)
+    {
+        std::ofstream file(path, std::ios::out | std::ios::binary | std::ios::trunc);
+        for (size_t i = 0; i < size; i++)
+            file.put((char)i);
+    }
+
+    ~RamFile()
+    {
+        std::error_code error;
+        std::filesystem::remove(path, error);
+    }
+
+    BYTE at(size_t offset)
+    {
+        std::ifstream file(path, std::ios::in | std::ios::binary);
+        file.seekg(offset);
+        return (BYTE)file.get();
+    }
+};
+
+void EcSysDump()
+{
+    RamFile ram;
+    EmbeddedController ec(defaultPortIo(ram.path));
+    assert(ec.driverFileExist && ec.driverLoaded && "ERROR: RAM file not opened");
+
+    EC_DUMP dump = ec.dump();
+    assert(dump.valid.all() && dump[0x00] == 0x00 && dump[0xFF] == 0xFF && "ERROR: full dump");
+    assert(ec.stats.transactions == 1 && "ERROR: a dump is a single read of the file");
+
+    EC_DUMP sparse = ec.dump(EC_REGISTERS().set(0x10).set(0x80));
+    assert(sparse.valid[0x10] && sparse.valid[0x80] && sparse[0x80] == 0x80 && "ERROR: sparse dump");
+    ec.close();
+}
+
+void EcSysReadWrite()
+{
+    RamFile ram;
+    EmbeddedController ec(std::make_shared<EcSysIo>(ram.path));
+
+    assert(ec.readByte(0x42) == 0x42 && "ERROR: byte read");
+    assert(ec.readWord(0x10) == 0x1110 && "ERROR: word read");
+    assert(ec.writeByte(0x20, 0xAB) && ram.at(0x20) == 0xAB && "ERROR: byte write");
+    assert(ec.writeWord(0x30, 0xBEEF) && ram.at(0x30) == 0xEF && ram.at(0x31) == 0xBE && "ERROR: word write");
+    assert(ec.readByte(0x20) == 0xAB && "ERROR: read back");
+    ec.close();
+}
+
+void EcSysShortFile()
+{
+    RamFile ram(0x10);
+    EmbeddedController ec(defaultPortIo(ram.path));
+
+    EC_DUMP dump = ec.dump();
+    assert(dump.valid.none() && ec.stats.reads.failures == 1 && "ERROR: a short file must fail the dump");
+    assert(ec.dump(EC_REGISTERS().set(0x04))[0x04] == 0x04 && "ERROR: registers inside the file stay readable");
+    ec.close();
+}
+
+#endif
+
+int main()
+{
+    std::vector<std::pair<const char*, std::function<void()>>> tests = {
+        { "HandshakeReadsAndWrites", HandshakeReadsAndWrites },
+        { "MultiByteOrder", MultiByteOrder },
+        { "RetryAfterBusyEc", RetryAfterBusyEc },
+        { "DeadEcIsBounded", DeadEcIsBounded },
+        { "BurstMode", BurstMode },
+        { "BurstRefusals", BurstRefusals },
+        { "LateBurstAcknowledge", LateBurstAcknowledge },
+        { "ConcurrentProducersDrainOnce", ConcurrentProducersDrainOnce },
+        { "AdjacentReadsMerged", AdjacentReadsMerged },
+        { "SafetyPreemptsBulk", SafetyPreemptsBulk },
+        { "ExpiredDeadlineRefused", ExpiredDeadlineRefused },
+        { "IdenticalReadsJoinFlight", IdenticalReadsJoinFlight },
+        { "InvalidatePreventsStaleFill", InvalidatePreventsStaleFill },
+        { "TelemetryDeltasRoundTrip", TelemetryDeltasRoundTrip },
+        { "TelemetryRingWrap", TelemetryRingWrap },
+        { "SummaryQuantiles", SummaryQuantiles },
+#ifndef _WIN32
+        { "EcSysDump", EcSysDump },
+        { "EcSysReadWrite", EcSysReadWrite },
+        { "EcSysShortFile", EcSysShortFile },
+#endif
+    };
+
+    for (auto& [name, test] : tests)
+    {
+        test();
+        std::cout << "ok " << name << std::endl;
+    }
+    std::cout << tests.size() << " tests passed" << std::endl;
+    return 0;
+}